@@ -1,3 +1,4 @@
+#include <memory>
 #include <sstream>
 
 #include "binder.hh"
@@ -19,33 +20,49 @@ void Binder::push_scope() { scopes.push_back(scope_t()); }
 /* Pops the current scope from the stack */
 void Binder::pop_scope() { scopes.pop_back(); }
 
-/* Enter a declaration in the current scope. Raises an error if the declared name
- * is already defined */
+/* Enter a declaration in the current scope and give it its id. Raises an
+ * error if the declared name is already defined */
 void Binder::enter(Decl &decl) {
   scope_t &scope = current_scope();
   auto previous = scope.find(decl.name);
   if (previous != scope.end()) {
     non_fatal_error(decl.loc,
-                    decl.name.get() + " is already defined in this scope");
+                    decl.name.get().to_string() +
+                        " is already defined in this scope");
     error(previous->second->loc, "previous declaration was here");
   }
   scope[decl.name] = &decl;
+  update(DeferredUpdate::set_id, decl);
 }
 
 /* Finds the declaration for a given name. The scope stack is traversed
- * front to back starting from the current scope. The first matching
- * declaration is returned. Raises an error, if no declaration matches. */
-Decl &Binder::find(const location loc, const Symbol &name) {
+ * front to back starting from the current scope, then the scopes of the
+ * outer binders. The first matching declaration is returned, or nullptr. */
+Decl *Binder::lookup(const Symbol &name) const {
   for (auto scope = scopes.crbegin(); scope != scopes.crend(); scope++) {
     auto decl_entry = scope->find(name);
     if (decl_entry != scope->cend()) {
-      return *decl_entry->second;
+      return decl_entry->second;
     }
   }
-  error(loc, name.get() + " cannot be found in this scope");
+  return outer ? outer->lookup(name) : nullptr;
+}
+
+/* Same as lookup, but raises an error if no declaration matches. */
+Decl &Binder::find(const location loc, const Symbol &name) {
+  if (Decl *decl = lookup(name))
+    return *decl;
+  error(loc, name.get().to_string() + " cannot be found in this scope");
 }
 
-Binder::Binder() : scopes() {
+/* Binder of a task binding a function body. Its scopes are on top of the
+ * ones of its outer binder, which does not change while the task runs. */
+Binder::Binder(const Binder *_outer)
+    : arena(_outer->arena), pool(_outer->pool), outer(_outer), scopes(),
+      functions(_outer->functions) {}
+
+Binder::Binder(utils::Arena &_arena, utils::ThreadPool *_pool)
+    : arena(_arena), pool(_pool), outer(nullptr), scopes() {
   /* Create the top-level scope */
   push_scope();
 
@@ -72,48 +89,111 @@ Binder::Binder() : scopes() {
 void Binder::enter_primitive(
     const std::string &name, const boost::optional<Symbol> &type_name,
     const std::vector<Symbol> &argument_typenames) {
-  std::vector<VarDecl *> args;
+  node_list<VarDecl *> args(arena);
   int counter = 0;
   for (const Symbol &tn : argument_typenames) {
     std::ostringstream argname;
     argname << "a_" << counter++;
     args.push_back(
-        new VarDecl(utils::nl, Symbol(argname.str()), nullptr, tn));
+        new (arena) VarDecl(utils::nl, Symbol(argname.str()), nullptr, tn));
   }
 
   boost::optional<Symbol> type_name_symbol = boost::none;
-  FunDecl *fd = new FunDecl(utils::nl, Symbol(name), std::move(args), nullptr,
-                            type_name, true);
+  FunDecl *fd = new (arena) FunDecl(utils::nl, Symbol(name), std::move(args),
+                                    nullptr, type_name, true);
   fd->set_external_name(Symbol("__" + name));
   enter(*fd);
+  primitives.push_back(fd);
 }
 
-/* Sets the parent of a function declaration and computes and sets
- * its unique external name */
+/* Sets the parent of a function declaration, and its unique external
+ * name once the names of the functions before it are known */
 void Binder::set_parent_and_external_name(FunDecl &decl) {
-  auto parent = functions.empty() ? nullptr : functions.back();
-  Symbol external_name;
-  if (parent) {
-    decl.set_parent(parent);
-    external_name = parent->get_external_name().get() + '.' + decl.name.get();
-  } else
-    external_name = decl.name;
-  while (external_names.find(external_name) != external_names.end())
-    external_name = Symbol(external_name.get() + '_');
-  external_names.insert(external_name);
-  decl.set_external_name(external_name);
+  if (!functions.empty())
+    decl.set_parent(functions.back());
+  update(DeferredUpdate::set_external_name, decl);
+}
+
+/* Applies an update to a declaration, or defers it to the outer binder
+ * in a task */
+void Binder::update(DeferredUpdate::Action action, Decl &decl) {
+  const DeferredUpdate deferred_update = {action, &decl};
+  if (outer)
+    deferred.push_back(deferred_update);
+  else
+    apply(deferred_update);
+}
+
+void Binder::apply(const DeferredUpdate &deferred_update) {
+  Decl &decl = *deferred_update.decl;
+  switch (deferred_update.action) {
+  case DeferredUpdate::set_id:
+    decl.set_id(decl_count++);
+    break;
+  case DeferredUpdate::set_escapes:
+    static_cast<VarDecl &>(decl).set_escapes();
+    break;
+  case DeferredUpdate::set_external_name: {
+    FunDecl &fun_decl = static_cast<FunDecl &>(decl);
+    optional<FunDecl &> parent = fun_decl.get_parent();
+    Symbol external_name;
+    if (parent)
+      external_name = parent->get_external_name().get().to_string() + '.' +
+                      decl.name.get().to_string();
+    else
+      external_name = decl.name;
+    while (external_names.find(external_name) != external_names.end())
+      external_name = Symbol(external_name.get().to_string() + '_');
+    external_names.insert(external_name);
+    fun_decl.set_external_name(external_name);
+    break;
+  }
+  }
+}
+
+/* Binds the bodies of consecutive functions, whose headers are already
+ * entered, as parallel tasks. Every task has its own binder on top of
+ * this one. Errors and deferred updates of the tasks are then taken in
+ * source order, so that the result is the same as a sequential binding */
+void Binder::bind_functions(const std::vector<FunDecl *> &decls) {
+  std::vector<std::unique_ptr<Binder>> binders;
+  std::vector<utils::Diagnostics> diagnostics(decls.size());
+  utils::TaskGroup group(*pool);
+  for (size_t i = 0; i < decls.size(); i++) {
+    binders.emplace_back(new Binder(this));
+    Binder &binder = *binders.back();
+    utils::Diagnostics &errors = diagnostics[i];
+    FunDecl &decl = *decls[i];
+    group.run([&binder, &errors, &decl] {
+      utils::CollectDiagnostics collect(errors);
+      try {
+        decl.accept(binder);
+      } catch (const utils::FatalError &) {
+      }
+    });
+  }
+  group.wait();
+
+  for (size_t i = 0; i < decls.size(); i++) {
+    diagnostics[i].report();
+    for (const DeferredUpdate &deferred_update : binders[i]->deferred)
+      update(deferred_update.action, *deferred_update.decl);
+  }
 }
 
 /* Binds a whole program. This method wraps the program inside a top-level main
  * function.  Then, it visits the programs with the Binder visitor; binding
  * each identifier to its declaration and computing depths.*/
 FunDecl *Binder::analyze_program(Expr &root) {
-  std::vector<VarDecl *> main_params;
-  Sequence *const main_body = new Sequence(
+  node_list<VarDecl *> main_params(arena);
+  Sequence *const main_body = new (arena) Sequence(
       utils::nl,
-      std::vector<Expr *>({&root, new IntegerLiteral(utils::nl, 0)}));
-  FunDecl *const main = new FunDecl(utils::nl, Symbol("main"), main_params,
-                                    main_body, Symbol("int"), true);
+      node_list<Expr *>({&root, new (arena) IntegerLiteral(utils::nl, 0)},
+                        arena));
+  FunDecl *const main =
+      new (arena) FunDecl(utils::nl, Symbol("main"), std::move(main_params),
+                          main_body, Symbol("int"), true);
+  main->set_id(decl_count++);
   main->accept(*this);
   return main;
 }
@@ -133,7 +213,7 @@ void Binder::visit(BinaryOperator &op)
 void Binder::visit(Sequence &seq)
 {
 
-  std::vector<Expr *> exprs = seq.get_exprs();
+  node_list<Expr *> &exprs = seq.get_exprs();
 
   for (Expr *expr : exprs)
   {
@@ -145,7 +225,7 @@ void Binder::visit(Let &let)
 {
   push_scope();
 
-  std::vector<Decl *> &decls = let.get_decls();
+  node_list<Decl *> &decls = let.get_decls();
   Sequence &seq = let.get_sequence();
   Loop *ex_current_loop = curr_loop;
   curr_loop = nullptr;
@@ -180,6 +260,11 @@ void Binder::visit(Let &let)
     }
 
     // consecutive func
+    if (pool && funDecls.size() > 1)
+    {
+      bind_functions(funDecls);
+      continue;
+    }
     for (FunDecl *decl : funDecls)
     {
       decl->accept(*this);
@@ -205,7 +290,7 @@ void Binder::visit(Identifier &id)
 
   // is it a escaping ?
   if (decl->get_depth() < id.get_depth()) {
-    decl->set_escapes();
+    update(DeferredUpdate::set_escapes, *decl);
   }
 }
 
@@ -235,7 +320,7 @@ void Binder::visit(FunDecl &decl)
   decl.set_depth(functions.size()-1);
 
   push_scope(); // we go in
-  std::vector<VarDecl *> &params = decl.get_params();
+  node_list<VarDecl *> &params = decl.get_params();
 
   // accept parameter of function
   for (VarDecl *decl : params)
@@ -266,7 +351,7 @@ void Binder::visit(FunCall &call)
   call.set_depth(functions.size());
 
   // attempt to solve mutually recursive functions issue
-  std::vector<Expr *> &args = call.get_args();
+  node_list<Expr *> &args = call.get_args();
   for (Expr *expr : args)
   {
     expr->accept(*this);
@@ -5,29 +5,55 @@
 #include <unordered_set>
 
 #include "nodes.hh"
+#include "../utils/thread_pool.hh"
 
 namespace ast {
 namespace binder {
 
 typedef std::unordered_map<Symbol, Decl *> scope_t;
 
+// Updates of declarations which depend on the order of the whole
+// program. A binder running as a task defers them, and its parent
+// applies them once the tasks before it are done.
+struct DeferredUpdate {
+  enum Action { set_id, set_external_name, set_escapes };
+  Action action;
+  Decl *decl;
+};
+
 class Binder : public ASTVisitor {
+  utils::Arena &arena; // arena holding the nodes created by the binder
+  utils::ThreadPool *const pool; // binds sibling function bodies in parallel
+  const Binder *const outer; // binder of the enclosing scopes, in a task
   Loop * curr_loop = nullptr; // class member variable to record the visited loops
   std::vector<scope_t> scopes;
   std::vector<FunDecl *> functions;
+  std::vector<FunDecl *> primitives;
   std::unordered_set<Symbol> external_names;
+  std::vector<DeferredUpdate> deferred;
+  int decl_count = 0; // number of declarations, which get dense ids
+  explicit Binder(const Binder *outer);
   void push_scope();
   void pop_scope();
   scope_t &current_scope();
   void enter(Decl &);
+  Decl *lookup(const Symbol &name) const;
   Decl &find(const location loc, const Symbol &name);
   void enter_primitive(const std::string &, const boost::optional<Symbol> &,
                        const std::vector<Symbol> &);
   void set_parent_and_external_name(FunDecl &decl);
+  void update(DeferredUpdate::Action, Decl &);
+  void apply(const DeferredUpdate &);
+  void bind_functions(const std::vector<FunDecl *> &);
 
 public:
-  Binder();
+  // With a pool, the bodies of sibling functions are bound in
+  // parallel. Ids and external names are the same as without one.
+  explicit Binder(utils::Arena &, utils::ThreadPool *pool = nullptr);
   FunDecl *analyze_program(Expr &);
+  // Declarations ids are below this bound
+  int get_decl_count() const { return decl_count; }
+  const std::vector<FunDecl *> &get_primitives() const { return primitives; }
   virtual void visit(IntegerLiteral &);
   virtual void visit(StringLiteral &);
   virtual void visit(BinaryOperator &);
@@ -5,13 +5,16 @@
 #define NODES_HH
 
 #include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <boost/optional.hpp>
 
 #include "../parser/location.hh"
+#include "../utils/arena.hh"
 #include "../utils/symbols.hh"
 
 namespace ast {
@@ -24,6 +27,11 @@ using utils::Symbol;
 using yy::location;
 
 typedef enum { t_undef = 0, t_int, t_string, t_void } Type;
+
+// Lists of children live in the same arena as the nodes.
+template <typename T>
+using node_list = std::vector<T, utils::ArenaAllocator<T>>;
+
 typedef enum {
   o_plus = 0,
   o_minus,
@@ -108,8 +116,12 @@ public:
   // Constructor
   Node(const location &_loc) : loc(_loc) {}
 
-  // Destructor
-  virtual ~Node() {}
+  // Nodes are allocated in the arena of their compilation, and are
+  // released all at once with it: they are never destroyed one by one.
+  static void *operator new(size_t size, utils::Arena &arena) {
+    return arena.allocate(size, alignof(std::max_align_t));
+  }
+  static void operator delete(void *, utils::Arena &) {}
 
   // Delete copy operator and constructor
   Node &operator=(const Node &) = delete;
@@ -140,6 +152,8 @@ public:
   // Public fields
   const Symbol name;
   int depth = -1;
+  // Dense identifier given by the binder, for side tables
+  int id = -1;
 
   // Constructor
   Decl(const location &_loc, const Symbol &_name) : Node(_loc), name(_name) {}
@@ -151,6 +165,14 @@ public:
   }
   int &get_depth() { return depth; }
   const int &get_depth() const { return depth; }
+
+  // Setter and getters for field `id'
+  void set_id(int _id) {
+    assert(id == -1 && _id != -1);
+    id = _id;
+  }
+  int &get_id() { return id; }
+  const int &get_id() const { return id; }
 };
 
 class IntegerLiteral : public Expr {
@@ -202,12 +224,6 @@ public:
                  const Operator &_op)
       : Expr(_loc), left(_left), right(_right), op(_op) {}
 
-  // Destructor
-  virtual ~BinaryOperator() {
-    delete right;
-    delete left;
-  }
-
   // Getters for field `left'
   Expr &get_left() { return *left; }
   const Expr &get_left() const { return *left; }
@@ -227,22 +243,16 @@ public:
 class Sequence : public Expr {
 
   // Private fields
-  std::vector<Expr *> exprs;
+  node_list<Expr *> exprs;
 
 public:
   // Constructor
-  Sequence(const location &_loc, const std::vector<Expr *> &_exprs)
-      : Expr(_loc), exprs(_exprs) {}
-
-  // Destructor
-  virtual ~Sequence() {
-    for (auto expr : exprs)
-      delete expr;
-  }
+  Sequence(const location &_loc, node_list<Expr *> _exprs)
+      : Expr(_loc), exprs(std::move(_exprs)) {}
 
   // Getters for field `exprs'
-  std::vector<Expr *> &get_exprs() { return exprs; }
-  const std::vector<Expr *> &get_exprs() const { return exprs; }
+  node_list<Expr *> &get_exprs() { return exprs; }
+  const node_list<Expr *> &get_exprs() const { return exprs; }
 
   // Acceptor method for visitors
   virtual void accept(ASTVisitor &visitor) { visitor.visit(*this); }
@@ -255,25 +265,17 @@ public:
 class Let : public Expr {
 
   // Private fields
-  std::vector<Decl *> decls;
+  node_list<Decl *> decls;
   Sequence *sequence;
 
 public:
   // Constructor
-  Let(const location &_loc, const std::vector<Decl *> &_decls,
-      Sequence *_sequence)
-      : Expr(_loc), decls(_decls), sequence(_sequence) {}
-
-  // Destructor
-  virtual ~Let() {
-    delete sequence;
-    for (auto decl : decls)
-      delete decl;
-  }
+  Let(const location &_loc, node_list<Decl *> _decls, Sequence *_sequence)
+      : Expr(_loc), decls(std::move(_decls)), sequence(_sequence) {}
 
   // Getters for field `decls'
-  std::vector<Decl *> &get_decls() { return decls; }
-  const std::vector<Decl *> &get_decls() const { return decls; }
+  node_list<Decl *> &get_decls() { return decls; }
+  const node_list<Decl *> &get_decls() const { return decls; }
 
   // Getters for field `sequence'
   Sequence &get_sequence() { return *sequence; }
@@ -347,13 +349,6 @@ public:
       : Expr(_loc), condition(_condition), then_part(_then_part),
         else_part(_else_part) {}
 
-  // Destructor
-  virtual ~IfThenElse() {
-    delete else_part;
-    delete then_part;
-    delete condition;
-  }
-
   // Getters for field `condition'
   Expr &get_condition() { return *condition; }
   const Expr &get_condition() const { return *condition; }
@@ -391,9 +386,6 @@ public:
       : Decl(_loc, _name), expr(_expr), type_name(_type_name),
         read_only(_read_only) {}
 
-  // Destructor
-  virtual ~VarDecl() { delete expr; }
-
   // Getters for field `expr'
   optional<Expr &> get_expr() {
     if (!expr)
@@ -422,11 +414,12 @@ public:
 class FunDecl : public Decl {
 
   // Private fields
-  std::vector<VarDecl *> params;
+  node_list<VarDecl *> params;
   Expr *expr;
   Symbol external_name = Symbol();
   FunDecl *parent = nullptr;
-  std::vector<VarDecl *> escaping_decls = std::vector<VarDecl *>();
+  node_list<VarDecl *> escaping_decls =
+      node_list<VarDecl *>(params.get_allocator());
 
 public:
   // Public fields
@@ -435,21 +428,14 @@ public:
 
   // Constructor
   FunDecl(const location &_loc, const Symbol &_name,
-          const std::vector<VarDecl *> &_params, Expr *_expr,
+          node_list<VarDecl *> _params, Expr *_expr,
           const optional<Symbol> &_type_name, const bool &_is_external = false)
-      : Decl(_loc, _name), params(_params), expr(_expr), type_name(_type_name),
-        is_external(_is_external) {}
-
-  // Destructor
-  virtual ~FunDecl() {
-    delete expr;
-    for (auto param : params)
-      delete param;
-  }
+      : Decl(_loc, _name), params(std::move(_params)), expr(_expr),
+        type_name(_type_name), is_external(_is_external) {}
 
   // Getters for field `params'
-  std::vector<VarDecl *> &get_params() { return params; }
-  const std::vector<VarDecl *> &get_params() const { return params; }
+  node_list<VarDecl *> &get_params() { return params; }
+  const node_list<VarDecl *> &get_params() const { return params; }
 
   // Getters for field `expr'
   optional<Expr &> get_expr() {
@@ -488,8 +474,8 @@ public:
   }
 
   // Getters for field `escaping_decls'
-  std::vector<VarDecl *> &get_escaping_decls() { return escaping_decls; }
-  const std::vector<VarDecl *> &get_escaping_decls() const {
+  node_list<VarDecl *> &get_escaping_decls() { return escaping_decls; }
+  const node_list<VarDecl *> &get_escaping_decls() const {
     return escaping_decls;
   }
 
@@ -504,7 +490,7 @@ public:
 class FunCall : public Expr {
 
   // Private fields
-  std::vector<Expr *> args;
+  node_list<Expr *> args;
   FunDecl *decl = nullptr;
   int depth = -1;
 
@@ -513,19 +499,13 @@ public:
   const Symbol func_name;
 
   // Constructor
-  FunCall(const location &_loc, const std::vector<Expr *> &_args,
+  FunCall(const location &_loc, node_list<Expr *> _args,
           const Symbol &_func_name)
-      : Expr(_loc), args(_args), func_name(_func_name) {}
-
-  // Destructor
-  virtual ~FunCall() {
-    for (auto arg : args)
-      delete arg;
-  }
+      : Expr(_loc), args(std::move(_args)), func_name(_func_name) {}
 
   // Getters for field `args'
-  std::vector<Expr *> &get_args() { return args; }
-  const std::vector<Expr *> &get_args() const { return args; }
+  node_list<Expr *> &get_args() { return args; }
+  const node_list<Expr *> &get_args() const { return args; }
 
   // Setter and getters for field `decl'
   void set_decl(FunDecl *_decl) {
@@ -576,12 +556,6 @@ public:
   WhileLoop(const location &_loc, Expr *_condition, Expr *_body)
       : Loop(_loc), condition(_condition), body(_body) {}
 
-  // Destructor
-  virtual ~WhileLoop() {
-    delete body;
-    delete condition;
-  }
-
   // Getters for field `condition'
   Expr &get_condition() { return *condition; }
   const Expr &get_condition() const { return *condition; }
@@ -610,13 +584,6 @@ public:
   ForLoop(const location &_loc, VarDecl *_variable, Expr *_high, Expr *_body)
       : Loop(_loc), variable(_variable), high(_high), body(_body) {}
 
-  // Destructor
-  virtual ~ForLoop() {
-    delete body;
-    delete high;
-    delete variable;
-  }
-
   // Getters for field `variable'
   VarDecl &get_variable() { return *variable; }
   const VarDecl &get_variable() const { return *variable; }
@@ -681,12 +648,6 @@ public:
   Assign(const location &_loc, Identifier *_lhs, Expr *_rhs)
       : Expr(_loc), lhs(_lhs), rhs(_rhs) {}
 
-  // Destructor
-  virtual ~Assign() {
-    delete rhs;
-    delete lhs;
-  }
-
   // Getters for field `lhs'
   Identifier &get_lhs() { return *lhs; }
   const Identifier &get_lhs() const { return *lhs; }
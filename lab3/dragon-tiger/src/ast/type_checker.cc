@@ -20,7 +20,7 @@ namespace ast
 
     void TypeChecker::visit(Sequence &seq)
     {
-      std::vector<Expr *> exprs = seq.get_exprs();
+      node_list<Expr *> &exprs = seq.get_exprs();
 
       Type type = t_void;
 
@@ -59,18 +59,92 @@ namespace ast
 
     void TypeChecker::visit(Let &let)
     {
-      std::vector<Decl *> &decls = let.get_decls();
+      node_list<Decl *> &decls = let.get_decls();
       Sequence &seq = let.get_sequence();
 
+      // consecutive functions may be checked in parallel
+      std::vector<FunDecl *> funDecls;
       for (Decl *decl : decls)
       {
+        FunDecl *funDecl = dynamic_cast<FunDecl *>(decl);
+        if (pool && funDecl)
+        {
+          funDecls.push_back(funDecl);
+          continue;
+        }
+        check_functions(funDecls);
+        funDecls.clear();
         decl->accept(*this);
       }
+      check_functions(funDecls);
 
       seq.accept(*this);
       let.set_type(seq.get_type());
     }
 
+    /* Checks the bodies of consecutive functions as parallel tasks, once
+     * their signatures are resolved: the tasks only read the types of the
+     * functions they call. Errors are reported in source order. */
+    void TypeChecker::check_functions(const std::vector<FunDecl *> &decls)
+    {
+      std::vector<FunDecl *> unchecked;
+      utils::Diagnostics signature_errors;
+      {
+        utils::CollectDiagnostics collect(signature_errors);
+        try
+        {
+          for (FunDecl *decl : decls)
+          {
+            if (decl->get_type() == t_undef)
+            {
+              resolve_signature(*decl);
+              unchecked.push_back(decl);
+            }
+          }
+        }
+        catch (const utils::FatalError &)
+        {
+        }
+      }
+
+      // an invalid signature stops checking where a sequential check would
+      if (unchecked.size() < 2 || signature_errors.failed())
+      {
+        for (FunDecl *decl : unchecked)
+        {
+          check_body(*decl);
+        }
+        signature_errors.report();
+        return;
+      }
+
+      std::vector<utils::Diagnostics> diagnostics(unchecked.size());
+      {
+        utils::TaskGroup group(*pool);
+        for (size_t i = 0; i < unchecked.size(); i++)
+        {
+          utils::Diagnostics &errors = diagnostics[i];
+          FunDecl &decl = *unchecked[i];
+          group.run([this, &errors, &decl] {
+            utils::CollectDiagnostics collect(errors);
+            try
+            {
+              TypeChecker checker(pool);
+              checker.check_body(decl);
+            }
+            catch (const utils::FatalError &)
+            {
+            }
+          });
+        }
+      }
+
+      for (const utils::Diagnostics &errors : diagnostics)
+      {
+        errors.report();
+      }
+    }
+
     void TypeChecker::visit(VarDecl &decl)
     {
       Type type = t_void;
@@ -232,59 +306,68 @@ namespace ast
     {
       if (decl.get_type() == t_undef)
       {
-        std::vector<VarDecl *> &params = decl.get_params();
+        resolve_signature(decl);
+        check_body(decl);
+      }
+    }
 
-        // accept parameter of function
-        for (VarDecl *decl : params)
-        {
-          decl->accept(*this);
-        }
+    void TypeChecker::resolve_signature(FunDecl &decl)
+    {
+      node_list<VarDecl *> &params = decl.get_params();
 
-        Type type = t_void;
+      // accept parameter of function
+      for (VarDecl *decl : params)
+      {
+        decl->accept(*this);
+      }
 
-        if (decl.type_name)
-        {
-          std::string type_name = std::string(decl.type_name.value());
+      Type type = t_void;
 
-          if (type_name == "int")
-          {
-            type = t_int;
-          }
-          else if (type_name == "string")
+      if (decl.type_name)
+      {
+        std::string type_name = std::string(decl.type_name.value());
+
+        if (type_name == "int")
+        {
+          type = t_int;
+        }
+        else if (type_name == "string")
+        {
+          type = t_string;
+        }
+        else if (type_name == "void")
+        {
+          // is it primitive
+          if (decl.is_external)
           {
-            type = t_string;
-          }
-          else if (type_name == "void")
-          {
-            // is it primitive
-            if (decl.is_external)
-            {
-              type = t_void;
-            }
-            else
-            {
-              error(decl.loc, "Explicit void type name is not allowed in non-primitive function declaration.");
-            }
+            type = t_void;
           }
           else
           {
-            error(decl.loc, "Incompatible type.");
+            error(decl.loc, "Explicit void type name is not allowed in non-primitive function declaration.");
           }
         }
+        else
+        {
+          error(decl.loc, "Incompatible type.");
+        }
+      }
 
-        decl.set_type(type);
+      decl.set_type(type);
+    }
 
-        Type type_e = t_undef;
-        // accept expr of function
-        optional<Expr &> expr = decl.get_expr();
-        if (expr)
+    void TypeChecker::check_body(FunDecl &decl)
+    {
+      Type type_e = t_undef;
+      // accept expr of function
+      optional<Expr &> expr = decl.get_expr();
+      if (expr)
+      {
+        expr.value().accept(*this);
+        type_e = expr.value().get_type();
+        if (decl.get_type() != type_e)
         {
-          expr.value().accept(*this);
-          type_e = expr.value().get_type();
-          if (type != type_e)
-          {
-            error(decl.loc, "Two different types for variable.");
-          }
+          error(decl.loc, "Two different types for variable.");
         }
       }
     }
@@ -293,8 +376,8 @@ namespace ast
     {
 
       optional<FunDecl &> decl = call.get_decl();
-      std::vector<VarDecl *> &params = decl.value().get_params();
-      std::vector<Expr *> &args = call.get_args();
+      node_list<VarDecl *> &params = decl.value().get_params();
+      node_list<Expr *> &args = call.get_args();
 
       // check if there is the right number of arguments
       if (args.size() != params.size())
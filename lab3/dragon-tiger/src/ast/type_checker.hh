@@ -2,14 +2,22 @@
 #define TYPE_CHECKER_HH
 
 #include "nodes.hh"
+#include "../utils/thread_pool.hh"
 
 namespace ast {
 namespace type_checker {
 
 class TypeChecker : public ASTVisitor {
+  utils::ThreadPool *const pool; // checks sibling function bodies in parallel
+  void check_body(FunDecl &);
+  void check_functions(const std::vector<FunDecl *> &);
 
 public:
-  TypeChecker() {}
+  // With a pool, the bodies of sibling functions are checked in
+  // parallel, once all their signatures are resolved. The signatures of
+  // the primitives must then be resolved beforehand.
+  explicit TypeChecker(utils::ThreadPool *_pool = nullptr) : pool(_pool) {}
+  void resolve_signature(FunDecl &);
   virtual void visit(IntegerLiteral &);
   virtual void visit(StringLiteral &);
   virtual void visit(Sequence &);
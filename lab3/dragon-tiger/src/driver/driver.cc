@@ -1,16 +1,59 @@
+#include <algorithm>
 #include <boost/program_options.hpp>
 #include <iostream>
+#include <sstream>
+#include <sys/stat.h>
 
 #include "../ast/ast_dumper.hh"
 #include "../ast/binder.hh"
 #include "../ast/type_checker.hh"
 #include "../parser/parser_driver.hh"
 #include "../utils/errors.hh"
+#include "../utils/symbols.hh"
+#include "../utils/thread_pool.hh"
+
+namespace po = boost::program_options;
+
+// Parse and analyze one file, and return its dump if it was requested.
+// With a pool, sibling function bodies are analyzed in parallel.
+static std::string compile(const std::string &input_file,
+                           const po::variables_map &vm,
+                           utils::ThreadPool *pool) {
+  ParserDriver parser_driver(vm.count("trace-lexer"), vm.count("trace-parser"));
+
+  if (!parser_driver.parse(input_file)) {
+    utils::error("parser failed");
+  }
+
+  FunDecl *main = nullptr;
+  if (vm.count("bind") || vm.count("type")) {
+    ast::binder::Binder binder(parser_driver.arena, pool);
+    main = binder.analyze_program(*parser_driver.result_ast);
+
+    if (vm.count("type")) {
+      ast::type_checker::TypeChecker typer(pool);
+      for (FunDecl *primitive : binder.get_primitives())
+        typer.resolve_signature(*primitive);
+      main->accept(typer);
+    }
+  }
+
+  std::ostringstream dump;
+  if (vm.count("dump-ast")) {
+    ast::ASTDumper dumper(&dump, vm.count("verbose") > 0);
+    if (main)
+      main->accept(dumper);
+    else
+      parser_driver.result_ast->accept(dumper);
+    dumper.nl();
+  }
+  return dump.str();
+}
 
 int main(int argc, char **argv) {
   std::string output_file;
   std::vector<std::string> input_files;
-  namespace po = boost::program_options;
+  unsigned jobs = 0;
   po::options_description options("Options");
   options.add_options()
   ("help,h", "describe arguments")
@@ -20,10 +63,14 @@ int main(int argc, char **argv) {
   ("trace-parser", "enable parser traces")
   ("trace-lexer", "enable lexer traces")
   ("verbose,v", "be verbose")
+  ("jobs,j", po::value(&jobs),
+   "number of files compiled in parallel (default: one per hardware thread)")
+  ("parallel-analysis",
+   "also bind and type-check sibling function bodies in parallel")
   ("input-file", po::value(&input_files), "input Tiger file");
 
   po::positional_options_description positional;
-  positional.add("input-file", 1);
+  positional.add("input-file", -1);
 
   po::variables_map vm;
   po::store(po::command_line_parser(argc, argv)
@@ -38,35 +85,40 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  if (input_files.size() != 1) {
-    utils::error("usage: dtiger [options] input-file");
+  if (input_files.empty()) {
+    utils::error("usage: dtiger [options] input-file...");
   }
 
-  ParserDriver parser_driver = ParserDriver(vm.count("trace-lexer"), vm.count("trace-parser"));
-
-  if (!parser_driver.parse(input_files[0])) {
-    utils::error("parser failed");
-  }
-
-  FunDecl *main = nullptr;
-  if (vm.count("bind") || vm.count("type")) {
-    ast::binder::Binder binder;
-    main = binder.analyze_program(*parser_driver.result_ast);
+  // The symbol table is sized for the sources before the files are
+  // compiled in parallel. A new symbol takes at least two bytes of
+  // source, so one bucket per eight bytes keeps the chains short.
+  size_t source_bytes = 0;
+  for (const std::string &input_file : input_files) {
+    struct stat st;
+    if (input_file != "-" && stat(input_file.c_str(), &st) == 0)
+      source_bytes += st.st_size;
   }
+  utils::Symbol::reserve(source_bytes / 8);
 
-  if (vm.count("type")) {
-    ast::type_checker::TypeChecker typer;
-    main->accept(typer);
-  }
-
-  if (vm.count("dump-ast")) {
-    ast::ASTDumper dumper(&std::cout, vm.count("verbose") > 0);
-    if (main)
-      main->accept(dumper);
-    else
-      parser_driver.result_ast->accept(dumper);
-    dumper.nl();
+  // Files are compiled independently, but their dumps are output in
+  // the order of the command line. Functions analyzed in parallel are
+  // tasks of the same pool as the files.
+  std::vector<std::string> dumps(input_files.size());
+  {
+    if (jobs == 0)
+      jobs = std::thread::hardware_concurrency();
+    const bool parallel_analysis = vm.count("parallel-analysis");
+    utils::ThreadPool pool(parallel_analysis
+                               ? jobs
+                               : std::min<size_t>(jobs, input_files.size()));
+    utils::ThreadPool *const function_pool =
+        parallel_analysis ? &pool : nullptr;
+    for (size_t i = 0; i < input_files.size(); i++)
+      pool.submit([&, i] {
+        dumps[i] = compile(input_files[i], vm, function_pool);
+      });
   }
-  delete parser_driver.result_ast;
+  for (const std::string &dump : dumps)
+    std::cout << dump;
   return 0;
 }
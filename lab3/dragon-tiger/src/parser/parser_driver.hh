@@ -1,11 +1,13 @@
 #include "../ast/nodes.hh"
+#include "../utils/arena.hh"
 #include "tiger_parser.hh"
 #include <string>
+#include <vector>
 
-// Tell Flex the lexer's prototype ...
-#define YY_DECL yy::tiger_parser::symbol_type yylex(ParserDriver &driver)
-// ... and declare it for the parser's sake.
-YY_DECL;
+class ParserDriver;
+
+// The parser gets its tokens from the scanner of its driver.
+yy::tiger_parser::symbol_type yylex(ParserDriver &driver);
 
 class ParserDriver {
 public:
@@ -17,6 +19,13 @@ public:
   void lex_begin();
   void lex_end();
 
+  // The state of the scanner. Drivers share nothing, so that several
+  // files can be parsed at once from different threads.
+  void *scanner = nullptr;
+  yy::location loc;
+  int comment_depth = 0;
+  std::string string_buffer;
+
   // Whether lexer or parser traces should be generated.
   bool trace_lexer;
   bool trace_parser;
@@ -24,6 +33,15 @@ public:
   // The parser produced AST
   Expr *result_ast;
 
+  // Arena owning the nodes of the AST. They are all released with
+  // the driver.
+  utils::Arena arena;
+
+  // Copy a list built by the parser into the arena.
+  template <typename T> node_list<T> list(const std::vector<T> &elements) {
+    return node_list<T>(elements.begin(), elements.end(), arena);
+  }
+
   // Run the parser on file f.
   // Returns true on success.
   bool parse(const std::string &f);
@@ -31,4 +49,12 @@ public:
   // The name of the file being parsed.
   // Used later to pass the file name to the location tracker.
   std::string file;
+
+  // The whole source being scanned, followed by two NUL bytes. It is
+  // either mapped from the file (mapped_length is then the size of
+  // the mapping), or read into source_copy.
+  char *source = nullptr;
+  size_t source_length = 0;
+  size_t mapped_length = 0;
+  std::vector<char> source_copy;
 };
@@ -3,23 +3,27 @@
 #include <cerrno>
 #include <climits>
 #include <cstdlib>
+#include <cstring>
 #include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "parser_driver.hh"
 #include "tiger_parser.hh"
 #include "../utils/errors.hh"
 
 #define TIGER_INT_MAX  2147483647  /*  2^31 - 1 */
 
-# undef yywrap
-# define yywrap() 1
-
-// The location of the current token
-static yy::location loc;
-static int comment_depth = 0;
-static std::string string_buffer;
+// The scanner is reentrant, and its state which is not handled by flex
+// lives in the driver. The parser calls yylex (see parser_driver.hh),
+// which runs the scanner of its driver.
+#define YY_DECL \
+  yy::tiger_parser::symbol_type tiger_scan(yyscan_t yyscanner, \
+                                           ParserDriver &driver)
 %}
 
-%option noyywrap nounput batch debug noinput
+%option reentrant noyywrap nounput batch debug noinput
 
 lineterminator  \r|\n|\r\n
 blank           [ \t\f]
@@ -38,6 +42,10 @@ int             [1-9][0-9]*|0
 
 %%
 %{
+  yy::location &loc = driver.loc;
+  int &comment_depth = driver.comment_depth;
+  std::string &string_buffer = driver.string_buffer;
+
   /* Before running the lexer, set the initial cursor position */
   loc.step ();
 %}
@@ -88,7 +96,7 @@ function return yy::tiger_parser::make_FUNCTION(loc);
 var      return yy::tiger_parser::make_VAR(loc);
 
  /* Identifiers */
-{id}       return yy::tiger_parser::make_ID(Symbol(yytext), loc);
+{id}       return yy::tiger_parser::make_ID(Symbol(yytext, yyleng), loc);
 
 {int} {
   long integ = strtol(yytext,NULL,0);
@@ -97,7 +105,12 @@ var      return yy::tiger_parser::make_VAR(loc);
   else 
     return yy::tiger_parser::make_INT(integ, loc);
     }
- /* Strings */
+ /* Strings without escapes are taken directly from the input buffer */
+\"[^"\\\r\n]*\" {
+  return yy::tiger_parser::make_STRING(Symbol(yytext + 1, yyleng - 2), loc);
+}
+
+ /* Other strings are built in string_buffer */
 \" {BEGIN(STRING); string_buffer.clear();}
 
 <STRING>{
@@ -125,7 +138,7 @@ var      return yy::tiger_parser::make_VAR(loc);
     "\\" utils::error (loc, "unescaping backslash");
 
     /* All other characters are accepted */
-    . {string_buffer.push_back(yytext[0]);}
+    [^"\\\r\n]+ {string_buffer.append(yytext, yyleng);}
 }
 
  /* Comments */
@@ -154,16 +167,75 @@ var      return yy::tiger_parser::make_VAR(loc);
 
 %%
 
+yy::tiger_parser::symbol_type yylex(ParserDriver &driver)
+{
+  return tiger_scan (driver.scanner, driver);
+}
+
+// Read the whole source at once, followed by the two NUL bytes flex
+// needs to scan it in place. Regular files are mapped in memory.
 void ParserDriver::lex_begin ()
 {
-  yy_flex_debug = trace_lexer;
-  if (file.empty () || file == "-")
-    yyin = stdin;
-  else if (!(yyin = fopen (file.c_str (), "r")))
+  if (yylex_init (&scanner))
+    utils::error("cannot create the scanner: " + std::string(strerror(errno)));
+  yyset_debug (trace_lexer, scanner);
+  loc.initialize (&file);
+  comment_depth = 0;
+
+  int fd = STDIN_FILENO;
+  if (!file.empty () && file != "-" &&
+      (fd = open (file.c_str (), O_RDONLY)) < 0)
     utils::error("cannot open " + file + ": " + strerror(errno));
+
+  struct stat st;
+  if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode))
+  {
+    // Map the file over a slightly larger anonymous zeroed area, so
+    // that the final NUL bytes are there even when the file size is
+    // a multiple of the page size. Private pages can be written by
+    // the scanner.
+    const size_t page = sysconf (_SC_PAGESIZE);
+    source_length = st.st_size;
+    mapped_length = (source_length + 2 + page - 1) / page * page;
+    void *area = mmap (nullptr, mapped_length, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED ||
+        (source_length > 0 &&
+         mmap (area, source_length, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED))
+      utils::error("cannot map " + file + ": " + strerror(errno));
+    source = static_cast<char *> (area);
+  }
+  else
+  {
+    char chunk[64 * 1024];
+    ssize_t length;
+    source_copy.clear ();
+    while ((length = read (fd, chunk, sizeof chunk)) != 0)
+    {
+      if (length < 0 && errno != EINTR)
+        utils::error("cannot read " + file + ": " + strerror(errno));
+      if (length > 0)
+        source_copy.insert (source_copy.end (), chunk, chunk + length);
+    }
+    source_length = source_copy.size ();
+    source_copy.resize (source_length + 2, '\0');
+    source = source_copy.data ();
+    mapped_length = 0;
+  }
+  if (fd != STDIN_FILENO)
+    close (fd);
+
+  yy_scan_buffer (source, source_length + 2, scanner);
 }
 
 void ParserDriver::lex_end ()
 {
-  fclose (yyin);
+  // This also releases the buffer.
+  yylex_destroy (scanner);
+  scanner = nullptr;
+  if (mapped_length)
+    munmap (source, mapped_length);
+  source_copy.clear ();
+  source = nullptr;
 }
@@ -140,84 +140,84 @@ expr: stringExpr { $$ = $1; }
 ;
 
 varDecl: VAR ID typeannotation ASSIGN expr
-  { $$ = new VarDecl(@1, $2, $5, $3); }
+  { $$ = new (driver.arena) VarDecl(@1, $2, $5, $3); }
 ;
 
 funcDecl: FUNCTION ID LPAREN params RPAREN typeannotation EQ expr
-  { $$ = new FunDecl(@1, $2, $4, $8, $6); }
+  { $$ = new (driver.arena) FunDecl(@1, $2, driver.list($4), $8, $6); }
 ;
 
 /* Exprs */
 
 stringExpr: STRING
-  { $$ = new StringLiteral(@1, $1); }
+  { $$ = new (driver.arena) StringLiteral(@1, $1); }
 ;
 
 intExpr: INT
-  { $$ = new IntegerLiteral(@1, $1); }
+  { $$ = new (driver.arena) IntegerLiteral(@1, $1); }
 ;
 
 var : ID
-  { $$ = new Identifier(@1, $1); }
+  { $$ = new (driver.arena) Identifier(@1, $1); }
 ;
 
 callExpr: ID LPAREN arguments RPAREN
-  { $$ = new FunCall(@1, $3, $1); }
+  { $$ = new (driver.arena) FunCall(@1, driver.list($3), $1); }
 ;
 
 negExpr: MINUS expr
-  { $$ = new BinaryOperator(@1, new IntegerLiteral(@1, 0), $2, o_minus); }
+  { $$ = new (driver.arena) BinaryOperator(@1, new (driver.arena) IntegerLiteral(@1, 0), $2, o_minus); }
   %prec UMINUS
 ;
 
 /*opExp: expr op expr*/
 
-opExpr: expr PLUS expr   { $$ = new BinaryOperator(@2, $1, $3, o_plus); }
-      | expr MINUS expr  { $$ = new BinaryOperator(@2, $1, $3, o_minus); }
-      | expr TIMES expr  { $$ = new BinaryOperator(@2, $1, $3, o_times); }
-      | expr DIVIDE expr { $$ = new BinaryOperator(@2, $1, $3, o_divide); }
-      | expr EQ expr     { $$ = new BinaryOperator(@2, $1, $3, o_eq); }
-      | expr NEQ expr    { $$ = new BinaryOperator(@2, $1, $3, o_neq); }
-      | expr LT expr     { $$ = new BinaryOperator(@2, $1, $3, o_lt); }
-      | expr GT expr     { $$ = new BinaryOperator(@2, $1, $3, o_gt); }
-      | expr LE expr     { $$ = new BinaryOperator(@2, $1, $3, o_le); }
-      | expr GE expr     { $$ = new BinaryOperator(@2, $1, $3, o_ge); }
+opExpr: expr PLUS expr   { $$ = new (driver.arena) BinaryOperator(@2, $1, $3, o_plus); }
+      | expr MINUS expr  { $$ = new (driver.arena) BinaryOperator(@2, $1, $3, o_minus); }
+      | expr TIMES expr  { $$ = new (driver.arena) BinaryOperator(@2, $1, $3, o_times); }
+      | expr DIVIDE expr { $$ = new (driver.arena) BinaryOperator(@2, $1, $3, o_divide); }
+      | expr EQ expr     { $$ = new (driver.arena) BinaryOperator(@2, $1, $3, o_eq); }
+      | expr NEQ expr    { $$ = new (driver.arena) BinaryOperator(@2, $1, $3, o_neq); }
+      | expr LT expr     { $$ = new (driver.arena) BinaryOperator(@2, $1, $3, o_lt); }
+      | expr GT expr     { $$ = new (driver.arena) BinaryOperator(@2, $1, $3, o_gt); }
+      | expr LE expr     { $$ = new (driver.arena) BinaryOperator(@2, $1, $3, o_le); }
+      | expr GE expr     { $$ = new (driver.arena) BinaryOperator(@2, $1, $3, o_ge); }
       | expr AND expr    {
-        $$ = new IfThenElse(@2, $1,
-                            new IfThenElse(@3, $3, new IntegerLiteral(nl, 1), new IntegerLiteral(nl, 0)),
-                            new IntegerLiteral(nl, 0));
+        $$ = new (driver.arena) IfThenElse(@2, $1,
+                            new (driver.arena) IfThenElse(@3, $3, new (driver.arena) IntegerLiteral(nl, 1), new (driver.arena) IntegerLiteral(nl, 0)),
+                            new (driver.arena) IntegerLiteral(nl, 0));
       }
       | expr OR expr     {
-        $$ = new IfThenElse(@2, $1,
-                            new IntegerLiteral(nl, 1),
-                            new IfThenElse(@3,$3, new IntegerLiteral(nl, 1), new IntegerLiteral(nl,0)));        
+        $$ = new (driver.arena) IfThenElse(@2, $1,
+                            new (driver.arena) IntegerLiteral(nl, 1),
+                            new (driver.arena) IfThenElse(@3,$3, new (driver.arena) IntegerLiteral(nl, 1), new (driver.arena) IntegerLiteral(nl,0)));        
       }
 ;
 
 
 assignExpr: ID ASSIGN expr
-  { $$ = new Assign(@2, new Identifier(@1, $1), $3); }
+  { $$ = new (driver.arena) Assign(@2, new (driver.arena) Identifier(@1, $1), $3); }
 ;
 
-whileExpr: WHILE expr DO expr { $$ = new WhileLoop(@1, $2, $4); }
+whileExpr: WHILE expr DO expr { $$ = new (driver.arena) WhileLoop(@1, $2, $4); }
 ;
 
-ifExpr: IF expr THEN expr ELSE expr { $$ = new IfThenElse(@1, $2, $4, $6); }
-      | IF expr THEN expr { $$ = new IfThenElse(@1, $2, $4, new Sequence(@4, std::vector<Expr *>())); }
+ifExpr: IF expr THEN expr ELSE expr { $$ = new (driver.arena) IfThenElse(@1, $2, $4, $6); }
+      | IF expr THEN expr { $$ = new (driver.arena) IfThenElse(@1, $2, $4, new (driver.arena) Sequence(@4, node_list<Expr *>(driver.arena))); }
 ;
 
 forExpr: FOR ID ASSIGN expr TO expr DO expr
-  { $$ = new ForLoop(@1, new VarDecl(@2, $2, $4, boost::none, true), $6, $8); }
+  { $$ = new (driver.arena) ForLoop(@1, new (driver.arena) VarDecl(@2, $2, $4, boost::none, true), $6, $8); }
 ;
 
-breakExpr: BREAK { $$ = new Break(@1); }
+breakExpr: BREAK { $$ = new (driver.arena) Break(@1); }
 ;
 
 letExpr: LET decls IN exprs END
-  { $$ = new Let(@1, $2, new Sequence(nl, $4)); }
+  { $$ = new (driver.arena) Let(@1, driver.list($2), new (driver.arena) Sequence(nl, driver.list($4))); }
 ;
 
-seqExpr : LPAREN exprs RPAREN { $$ = new Sequence(@1, $2); }
+seqExpr : LPAREN exprs RPAREN { $$ = new (driver.arena) Sequence(@1, driver.list($2)); }
 ;
 
 exprs: { $$ = std::vector<Expr *>(); }
@@ -264,7 +264,7 @@ decls: { $$ = std::vector<Decl *>();}
   }
 ;
 
-param: ID COLON ID { $$ = new VarDecl(@1, $1, nullptr, $3); }
+param: ID COLON ID { $$ = new (driver.arena) VarDecl(@1, $1, nullptr, $3); }
 ;
 
 typeannotation: { $$ = boost::none; }
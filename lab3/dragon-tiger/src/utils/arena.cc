@@ -0,0 +1,38 @@
+#include <algorithm>
+#include <new>
+
+#include "arena.hh"
+
+namespace {
+
+// Size of the regular chunks. Larger requests get a chunk of their own.
+const size_t chunk_size = 64 * 1024;
+
+} // namespace
+
+namespace utils {
+
+Arena::~Arena() {
+  for (char *chunk : chunks)
+    ::operator delete(chunk);
+}
+
+void *Arena::grow(size_t size, size_t align) {
+  const size_t needed = size + align - 1;
+  char *const chunk =
+      static_cast<char *>(::operator new(std::max(needed, chunk_size)));
+  chunks.push_back(chunk);
+
+  const uintptr_t start =
+      (reinterpret_cast<uintptr_t>(chunk) + align - 1) & ~uintptr_t(align - 1);
+  // Keep bumping in the current chunk if the new one was only needed
+  // for a large request and has no room left.
+  if (needed < chunk_size) {
+    next = start + size;
+    end = reinterpret_cast<uintptr_t>(chunk) + chunk_size;
+  }
+  allocated += size;
+  return reinterpret_cast<void *>(start);
+}
+
+} // namespace utils
@@ -0,0 +1,74 @@
+#ifndef ARENA_HH
+#define ARENA_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace utils {
+
+// Arena is a bump-pointer allocator. Memory is carved out of large
+// chunks and released all at once when the arena is destroyed. The
+// destructors of the objects allocated in an arena are never run, so
+// they must not own anything outside of it.
+//
+// An arena is not thread-safe, every compilation uses its own.
+
+class Arena {
+  std::vector<char *> chunks;
+  uintptr_t next = 0;
+  uintptr_t end = 0;
+  size_t allocated = 0;
+
+  // Allocate from a new chunk.
+  void *grow(size_t size, size_t align);
+
+public:
+  Arena() {}
+  ~Arena();
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void *allocate(size_t size, size_t align) {
+    const uintptr_t start = (next + align - 1) & ~uintptr_t(align - 1);
+    if (start + size > end || start < next)
+      return grow(size, align);
+    next = start + size;
+    allocated += size;
+    return reinterpret_cast<void *>(start);
+  }
+
+  // Number of bytes handed out by the arena.
+  size_t bytes_allocated() const { return allocated; }
+};
+
+// Standard allocator drawing from an arena, so that containers can
+// live in it. Deallocation is a no-op.
+template <typename T> class ArenaAllocator {
+  Arena *arena;
+
+  template <typename U> friend class ArenaAllocator;
+
+public:
+  typedef T value_type;
+
+  ArenaAllocator(Arena &_arena) : arena(&_arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *, size_t) {}
+
+  template <typename U> bool operator==(const ArenaAllocator<U> &other) const {
+    return arena == other.arena;
+  }
+  template <typename U> bool operator!=(const ArenaAllocator<U> &other) const {
+    return arena != other.arena;
+  }
+};
+
+} // namespace utils
+
+#endif // ARENA_HH
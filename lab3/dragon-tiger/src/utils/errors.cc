@@ -1,24 +1,76 @@
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
+#include <sstream>
 
 #include "errors.hh"
 
 namespace utils {
 
+// Several files may be compiled at once: messages are written whole,
+// and the first fatal error stops every thread while it holds the lock.
+static std::mutex error_mutex;
+
+// Diagnostics collecting the errors of the current thread, if any.
+static thread_local Diagnostics *collector = nullptr;
+
+static std::string located(const yy::location &l, const std::string &m) {
+  std::ostringstream message;
+  message << l << ": " << m;
+  return message.str();
+}
+
 void non_fatal_error(const yy::location &l, const std::string &m) {
-  std::cerr << l << ": " << m << std::endl;
+  non_fatal_error(located(l, m));
 }
 
-void non_fatal_error(const std::string &m) { std::cerr << m << std::endl; }
+void non_fatal_error(const std::string &m) {
+  if (collector) {
+    collector->add(m, false);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(error_mutex);
+  std::cerr << m << std::endl;
+}
 
 void error(const yy::location &l, const std::string &m) {
-  non_fatal_error(l, m);
-  exit(EXIT_FAILURE);
+  error(located(l, m));
 }
 
 void error(const std::string &m) {
-  non_fatal_error(m);
+  if (collector) {
+    collector->add(m, true);
+    throw FatalError();
+  }
+  error_mutex.lock();
+  std::cerr << m << std::endl;
   exit(EXIT_FAILURE);
 }
 
+void Diagnostics::add(const std::string &message, bool is_fatal) {
+  messages.push_back(message);
+  fatal = is_fatal;
+}
+
+void Diagnostics::report() const {
+  for (size_t i = 0; i < messages.size(); i++) {
+    if (fatal && i + 1 == messages.size())
+      error(messages[i]);
+    non_fatal_error(messages[i]);
+  }
+}
+
+CollectDiagnostics::CollectDiagnostics(Diagnostics &diagnostics)
+    : previous(collector) {
+  collector = &diagnostics;
+}
+
+CollectDiagnostics::~CollectDiagnostics() { collector = previous; }
+
+SuspendDiagnostics::SuspendDiagnostics() : previous(collector) {
+  collector = nullptr;
+}
+
+SuspendDiagnostics::~SuspendDiagnostics() { collector = previous; }
+
 } // namespace utils
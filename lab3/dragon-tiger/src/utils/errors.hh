@@ -1,6 +1,9 @@
 #ifndef ERRORS_HH
 #define ERRORS_HH
 
+#include <string>
+#include <vector>
+
 #include "../parser/tiger_parser.hh"
 
 namespace utils {
@@ -11,6 +14,46 @@ namespace utils {
 void non_fatal_error(const yy::location &l, const std::string &m);
 void non_fatal_error(const std::string &m);
 
+// Diagnostics holds the messages of a task analyzing part of a program
+// in parallel with others, so that they are reported in source order.
+class Diagnostics {
+  std::vector<std::string> messages;
+  bool fatal = false;
+
+public:
+  void add(const std::string &message, bool is_fatal);
+  bool failed() const { return fatal; }
+  // Emit the messages again, ending with the fatal error if any: to
+  // the collector of the current thread if there is one, otherwise on
+  // the standard error.
+  void report() const;
+};
+
+// While a CollectDiagnostics is in scope, the errors of the current
+// thread go to its diagnostics, and error() throws a FatalError
+// instead of exiting.
+class CollectDiagnostics {
+  Diagnostics *const previous;
+
+public:
+  explicit CollectDiagnostics(Diagnostics &diagnostics);
+  ~CollectDiagnostics();
+};
+
+// While a SuspendDiagnostics is in scope, the errors of the current
+// thread are reported directly, even within a CollectDiagnostics. A
+// thread waiting for other tasks runs unrelated ones meanwhile, whose
+// errors are not those of the task it waits in.
+class SuspendDiagnostics {
+  Diagnostics *const previous;
+
+public:
+  SuspendDiagnostics();
+  ~SuspendDiagnostics();
+};
+
+struct FatalError {};
+
 } // namespace utils
 
 #endif // ERRORS_HH
@@ -1,35 +1,106 @@
-#include <unordered_set>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
 
+#include "arena.hh"
 #include "symbols.hh"
 
 namespace {
 
-struct Hash {
-  size_t operator()(std::string const *s) const noexcept {
-    return std::hash<std::string>()(*s);
-  }
-};
+typedef utils::Symbol::Entry Entry;
 
-struct Cmp {
-  bool operator()(std::string const *a, std::string const *b) const noexcept {
-    return *a == *b;
-  }
-};
+// The interning table has a power of two number of buckets, each one
+// holding a chain of entries. Entries are pushed at the head of their
+// chain with a compare-and-swap and are never removed, so lookups need no
+// lock. The buckets start in a static array, so that symbols can be
+// created before main, and move to a larger one in Symbol::reserve.
+const size_t initial_bucket_count = 1 << 16;
+std::atomic<const Entry *> initial_buckets[initial_bucket_count];
+std::atomic<const Entry *> *buckets = initial_buckets;
+size_t bucket_count = initial_bucket_count;
+
+// FNV-1a, computed directly on the characters so that no string needs to
+// be built before the lookup.
+size_t hash_chars(const char *s, size_t length) {
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < length; i++)
+    hash = (hash ^ (unsigned char)s[i]) * 1099511628211ull;
+  return hash;
+}
 
-std::unordered_set<const std::string *, Hash, Cmp> *symbols;
+// Look for a string in a chain, from entry first up to entry last.
+const Entry *find(const Entry *first, const Entry *last, const char *s,
+                  size_t length, size_t hash) {
+  for (const Entry *entry = first; entry != last; entry = entry->next)
+    if (entry->hash == hash && entry->length == length &&
+        std::memcmp(entry->chars(), s, length) == 0)
+      return entry;
+  return nullptr;
+}
+
+// Entries are allocated in an arena per thread, which is never released.
+utils::Arena &thread_arena() {
+  thread_local utils::Arena *arena = new utils::Arena();
+  return *arena;
+}
 
 } // namespace
 
 namespace utils {
 
-Symbol::Symbol(std::string const &s) {
-  if (symbols == nullptr)
-    symbols = new std::unordered_set<const std::string *, Hash, Cmp>();
-  auto f = symbols->find(&s);
-  if (f == symbols->end())
-    str = *symbols->insert(new std::string(s)).first;
-  else
-    str = *f;
+Symbol::Symbol(const char *s, size_t length) {
+  const size_t hash = hash_chars(s, length);
+  std::atomic<const Entry *> &bucket = buckets[hash & (bucket_count - 1)];
+
+  const Entry *head = bucket.load(std::memory_order_acquire);
+  entry = find(head, nullptr, s, length, hash);
+  if (entry)
+    return;
+
+  void *const memory =
+      thread_arena().allocate(sizeof(Entry) + length, alignof(Entry));
+  Entry *const fresh = new (memory) Entry{hash, length, head};
+  std::memcpy(reinterpret_cast<char *>(fresh + 1), s, length);
+  // If another thread changed the chain in the meantime, only the entries
+  // in front of the previous head need to be checked again.
+  const Entry *checked = head;
+  while (!bucket.compare_exchange_weak(head, fresh, std::memory_order_release,
+                                       std::memory_order_acquire)) {
+    entry = find(head, checked, s, length, hash);
+    if (entry)
+      return;
+    checked = fresh->next = head;
+  }
+  entry = fresh;
+}
+
+void Symbol::reserve(size_t count) {
+  size_t new_count = bucket_count;
+  while (new_count < count)
+    new_count *= 2;
+  if (new_count == bucket_count)
+    return;
+
+  // The chains are rebuilt in the new buckets, which are zero-initialized.
+  std::atomic<const Entry *> *const new_buckets =
+      new std::atomic<const Entry *>[new_count]();
+  for (size_t i = 0; i < bucket_count; i++) {
+    const Entry *next;
+    for (const Entry *entry = buckets[i].load(std::memory_order_relaxed);
+         entry; entry = next) {
+      next = entry->next;
+      std::atomic<const Entry *> &bucket =
+          new_buckets[entry->hash & (new_count - 1)];
+      const_cast<Entry *>(entry)->next =
+          bucket.load(std::memory_order_relaxed);
+      bucket.store(entry, std::memory_order_relaxed);
+    }
+  }
+  if (buckets != initial_buckets)
+    delete[] buckets;
+  buckets = new_buckets;
+  bucket_count = new_count;
 }
 
 } // namespace utils
@@ -1,6 +1,7 @@
 #ifndef SYMBOLS_HH
 #define SYMBOLS_HH
 
+#include <boost/utility/string_ref.hpp>
 #include <ostream>
 #include <string>
 
@@ -9,26 +10,54 @@ namespace utils {
 // Symbol is a small implementation of the flyweight pattern. Strings are
 // stored through a pointer. Similar strings will use the same instance in
 // memory, and comparaison is fast since it boils down to comparing two
-// pointers.
+// pointers. The hash of the string is computed once, when it is interned.
 //
-// This implementation is not thread-safe, but the dragon-tiger compiler
-// is single-threaded.
+// Symbols can be created concurrently from several threads: the interning
+// table is lock-free. Interned strings are never released. The table does
+// not grow by itself, Symbol::reserve sizes it for the input before any
+// symbol is created from the sources.
 
 class Symbol {
-  const std::string *str;
+public:
+  // An interned string, shared by all the symbols with the same contents.
+  // Its characters follow it in the same allocation.
+  struct Entry {
+    const size_t hash;
+    const size_t length;
+    // Next entry in the same bucket of the interning table.
+    const Entry *next;
+
+    const char *chars() const {
+      return reinterpret_cast<const char *>(this + 1);
+    }
+  };
+
+private:
+  const Entry *entry;
 
 public:
-  Symbol() : str(nullptr) {}
-  Symbol(std::string const &);
-  Symbol(Symbol const &s) : str(s.str) {}
-  size_t hash() const noexcept { return std::hash<std::string>()(*str); }
-  std::string const &get() const { return *str; }
-  operator std::string() const { return *str; }
-  bool operator==(Symbol const &other) const { return str == other.str; }
-  bool operator!=(Symbol const &other) const { return str != other.str; }
+  Symbol() : entry(nullptr) {}
+  Symbol(std::string const &s) : Symbol(s.data(), s.size()) {}
+  // Intern length chars from s, copying them only if they are new.
+  Symbol(const char *s, size_t length);
+  Symbol(Symbol const &s) : entry(s.entry) {}
+  size_t hash() const noexcept { return entry->hash; }
+  // The characters of the symbol, without copying them.
+  boost::string_ref get() const {
+    return boost::string_ref(entry->chars(), entry->length);
+  }
+  operator std::string() const { return get().to_string(); }
+  bool operator==(Symbol const &other) const { return entry == other.entry; }
+  bool operator!=(Symbol const &other) const { return entry != other.entry; }
   friend std::ostream &operator<<(std::ostream &o, Symbol const &s) {
-    return o << (s.str ? *s.str : "<null>");
+    if (!s.entry)
+      return o << "<null>";
+    return o << s.get();
   }
+
+  // Make room in the interning table for about count symbols. This must
+  // not run while other threads create symbols.
+  static void reserve(size_t count);
 };
 
 } // namespace utils
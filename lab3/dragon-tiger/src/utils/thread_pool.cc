@@ -0,0 +1,154 @@
+#include <algorithm>
+
+#include "errors.hh"
+#include "thread_pool.hh"
+
+namespace utils {
+
+// Pool and queue of the worker running on the current thread, if any.
+static thread_local ThreadPool *current_pool = nullptr;
+static thread_local unsigned current_index = 0;
+
+ThreadPool::ThreadPool(unsigned count) : queued(0) {
+  if (count == 0)
+    count = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned q = 0; q <= count; q++)
+    queues.emplace_back(new Queue);
+  for (unsigned w = 0; w < count; w++)
+    workers.emplace_back(&ThreadPool::work, this, w);
+}
+
+ThreadPool::~ThreadPool() {
+  wait();
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  task_ready.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+void ThreadPool::submit(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    pending++;
+  }
+  Queue &queue =
+      current_pool == this ? *queues[current_index] : *queues.back();
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  queued++;
+  // A worker checks the count under the lock before it sleeps, so it
+  // either sees the new task or gets the notification.
+  { std::lock_guard<std::mutex> lock(mutex); }
+  task_ready.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  all_done.wait(lock, [this] { return pending == 0; });
+}
+
+// A worker takes the newest task of its own queue, whose data is the
+// most likely to be in its cache, then the oldest shared task, then
+// the oldest task of another worker, which is usually the largest.
+bool ThreadPool::take(Task &task) {
+  const bool worker = current_pool == this;
+  if (worker) {
+    Queue &own = *queues[current_index];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+      return true;
+    }
+  }
+  const size_t count = queues.size();
+  const size_t first = worker ? current_index + 1 : count - 1;
+  for (size_t i = 0; i < count; i++) {
+    Queue &queue = *queues[(first + i) % count];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ThreadPool::run_pending() {
+  Task task;
+  if (!take(task))
+    return false;
+  queued--;
+  // The task is completed even if it throws.
+  struct Completion {
+    ThreadPool &pool;
+    ~Completion() {
+      std::lock_guard<std::mutex> lock(pool.mutex);
+      if (--pool.pending == 0)
+        pool.all_done.notify_all();
+    }
+  } completion{*this};
+  // The calling thread may be waiting within another task, which
+  // collects its own errors.
+  SuspendDiagnostics suspend;
+  task();
+  return true;
+}
+
+void ThreadPool::work(unsigned index) {
+  current_pool = this;
+  current_index = index;
+  for (;;) {
+    if (run_pending())
+      continue;
+    std::unique_lock<std::mutex> lock(mutex);
+    task_ready.wait(lock, [this] { return stopping || queued > 0; });
+    if (stopping && queued == 0)
+      return;
+  }
+}
+
+void TaskGroup::run(ThreadPool::Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running++;
+  }
+  pool.submit([this, task] {
+    struct Completion {
+      TaskGroup &group;
+      ~Completion() { group.complete(); }
+    } completion{*this};
+    task();
+  });
+}
+
+void TaskGroup::complete() {
+  std::lock_guard<std::mutex> lock(mutex);
+  running--;
+  finished.notify_all();
+}
+
+// The count is only read under the lock, so that the group cannot be
+// destroyed while a task still notifies it.
+void TaskGroup::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while (running > 0) {
+    lock.unlock();
+    const bool ran = pool.run_pending();
+    lock.lock();
+    // Nothing is queued: the tasks left run on other threads, and may
+    // queue more tasks once one of them is done.
+    if (!ran && running > 0) {
+      const size_t left = running;
+      finished.wait(lock, [this, left] { return running < left; });
+    }
+  }
+}
+
+} // namespace utils
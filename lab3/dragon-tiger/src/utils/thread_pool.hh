@@ -0,0 +1,97 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace utils {
+
+// ThreadPool runs tasks on a fixed set of worker threads. Every worker
+// has its own deque: tasks submitted by a worker go to the back of its
+// deque, where it takes its next task, and idle workers steal the
+// oldest tasks from the front of the other deques. Tasks submitted by
+// other threads go to a deque shared by all the workers. Tasks run by
+// the workers must not throw. Every task runs without the collector of
+// diagnostics of the thread running it (see errors.hh).
+
+class ThreadPool {
+public:
+  typedef std::function<void()> Task;
+
+  // Start the given number of workers, or one per hardware thread
+  // when it is 0.
+  explicit ThreadPool(unsigned workers = 0);
+  // Wait for the pending tasks, then stop the workers.
+  ~ThreadPool();
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  void submit(Task task);
+  // Block until every submitted task has completed. Must not be
+  // called by a task, which should use a TaskGroup instead.
+  void wait();
+  // Run a queued task on the calling thread, if there is one. Returns
+  // whether a task was run. An exception of the task propagates to the
+  // caller, the task being completed.
+  bool run_pending();
+  unsigned size() const { return workers.size(); }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  bool take(Task &task);
+  void work(unsigned index);
+
+  // One queue per worker, then the shared one.
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable task_ready;
+  std::condition_variable all_done;
+  // Tasks in the queues.
+  std::atomic<size_t> queued;
+  // Tasks submitted and not completed yet.
+  size_t pending = 0;
+  bool stopping = false;
+};
+
+// TaskGroup runs related tasks on a pool and waits for them. While it
+// waits, the calling thread runs queued tasks, so that tasks can
+// themselves wait for groups of smaller tasks without starving the
+// pool. When nothing is queued, it sleeps until one of its tasks
+// completes.
+
+class TaskGroup {
+public:
+  explicit TaskGroup(ThreadPool &_pool) : pool(_pool) {}
+  ~TaskGroup() { wait(); }
+  TaskGroup(const TaskGroup &) = delete;
+  TaskGroup &operator=(const TaskGroup &) = delete;
+
+  void run(ThreadPool::Task task);
+  // Block until every task of the group has completed.
+  void wait();
+
+private:
+  void complete();
+
+  ThreadPool &pool;
+  std::mutex mutex;
+  std::condition_variable finished;
+  // Tasks run and not completed yet.
+  size_t running = 0;
+};
+
+} // namespace utils
+
+#endif // THREAD_POOL_HH
@@ -0,0 +1,101 @@
+#! /bin/sh
+#
+# Compile and run the benchmark programs, and print their measures as
+# JSON on the standard output.
+#
+# Usage: bench.sh dtiger directory [runs]
+#
+# Every program of the directory is compiled like compile does, but
+# without the cache. For each one, the output records the time of
+# every phase of dtiger (from its --trace-passes trace), the total
+# compilation time, the size of the executable and the best run time
+# out of several runs. Times are in microseconds. Programs read a
+# generated text on their standard input, which only the filters use,
+# and the checksum of their output must be the one listed in the
+# checksums file of the directory, also when run with --run -O2.
+
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $(basename "$0") dtiger directory [runs]" 1>&2
+  exit 1
+fi
+
+dtiger="$1"
+directory="$2"
+runs="${3:-5}"
+
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+
+# Microseconds since the epoch (GNU date).
+now() {
+  echo $(( $(date +%s%N) / 1000 ))
+}
+
+awk 'BEGIN {
+  for (i = 1; i <= 20000; i++) {
+    line = "";
+    for (w = 0; w < 8; w++)
+      line = line (w ? " " : "") "word" (i * 7 + w * 13) % 1000;
+    print line;
+  }
+}' > "$work/input"
+
+commit="$(git -C "$directory" rev-parse HEAD 2>/dev/null || echo unknown)"
+
+echo "{"
+echo "  \"commit\": \"$commit\","
+echo "  \"date\": \"$(date -u +%Y-%m-%dT%H:%M:%SZ)\","
+echo "  \"runs\": $runs,"
+echo "  \"benchmarks\": ["
+
+separator=""
+for program in "$directory"/*.tig; do
+  name="$(basename "$program" .tig)"
+  echo "$name" 1>&2
+
+  start="$(now)"
+  "$dtiger" -O3 --trace-passes "$work/trace.json" -o "$work/$name" "$program"
+  compile="$(( $(now) - start ))"
+  size="$(wc -c < "$work/$name" | tr -d ' ')"
+
+  best=""
+  run=0
+  while [ "$run" -lt "$runs" ]; do
+    start="$(now)"
+    "$work/$name" < "$work/input" > "$work/output"
+    time="$(( $(now) - start ))"
+    if [ -z "$best" ] || [ "$time" -lt "$best" ]; then
+      best="$time"
+    fi
+    run=$((run + 1))
+  done
+
+  expected="$(sed -n "s/^$name //p" "$directory/checksums")"
+  if [ "$(cksum < "$work/output")" != "$expected" ]; then
+    echo "$name: unexpected output" 1>&2
+    exit 1
+  fi
+
+  # The JIT must give the same output as the executable.
+  "$dtiger" -O2 --run "$program" < "$work/input" > "$work/output"
+  if [ "$(cksum < "$work/output")" != "$expected" ]; then
+    echo "$name: unexpected output with --run -O2" 1>&2
+    exit 1
+  fi
+
+  # One phase per line of the trace: "name": duration.
+  phases="$(sed -n 's/.*"name":"\([^"]*\)".*"dur":\([0-9.]*\).*/"\1": \2/p' \
+              "$work/trace.json" | paste -s -d , - | sed 's/,/, /g')"
+
+  printf '%s    {"name": "%s", "compile_us": %s, "size": %s, "run_us": %s,\n' \
+    "$separator" "$name" "$compile" "$size" "$best"
+  printf '     "phases_us": {%s}}' "$phases"
+  separator=",
+"
+done
+
+echo
+echo "  ]"
+echo "}"
@@ -0,0 +1,138 @@
+#! /bin/sh
+#
+# Generate a well-typed Tiger program of a given size on the standard
+# output, to measure how the compiler scales with its input.
+#
+# Usage: generate.sh kind size
+#
+# Kinds:
+#   functions  size mutually recursive functions in a single let
+#   siblings   size sibling lets declaring functions of the same name
+#   depth      functions nested size levels deep, the innermost one
+#              using the parameters of all the others
+#   variables  size variables of one function, all used by a nested
+#              function
+#   sequence   a sequence of size assignments
+#   string     a string literal of size characters
+#
+# Every program prints a single number, which depends on the size.
+
+if [ $# -ne 2 ]; then
+  echo "Usage: $(basename "$0") kind size" 1>&2
+  exit 1
+fi
+
+case "$1" in
+  functions|siblings|depth|variables|sequence|string) ;;
+  *)
+    echo "$(basename "$0"): unknown kind $1" 1>&2
+    exit 1
+    ;;
+esac
+
+case "$2" in
+  ''|*[!0-9]*|0)
+    echo "$(basename "$0"): the size must be a positive number" 1>&2
+    exit 1
+    ;;
+esac
+
+exec awk -v kind="$1" -v n="$2" '
+function indent(level) {
+  return sprintf("%*s", 2 * level, "");
+}
+
+# f(i) calls f(i - 1), so that the whole let is one group of
+# functions, which are bound and checked together.
+function functions(   i) {
+  print "let";
+  print "  function f0(x: int): int = x + 1";
+  for (i = 1; i < n; i++)
+    printf "  function f%d(x: int): int = f%d(x) + 1\n", i, i - 1;
+  print "in";
+  printf "  print_int(f%d(0)); print(\"\\n\")\n", n - 1;
+  print "end";
+}
+
+# All the functions have the same name in the same parent, so that
+# each one needs a new external name.
+function siblings(   i) {
+  print "let";
+  print "  var sum := 0";
+  print "in";
+  for (i = 0; i < n; i++)
+    printf "  sum := sum + (let function f(x: int): int = x + %d in f(1) end);\n", i;
+  print "  print_int(sum); print(\"\\n\")";
+  print "end";
+}
+
+# The declarations are not indented by their depth, so that the size
+# of the source stays linear.
+function depth(   i, sum) {
+  print "let";
+  for (i = 0; i < n; i++) {
+    printf "  function d%d(x%d: int): int =\n", i, i;
+    if (i < n - 1)
+      print "  let";
+  }
+  sum = "x0";
+  for (i = 1; i < n; i++)
+    sum = sum " + x" i;
+  printf "    %s\n", sum;
+  for (i = n - 2; i >= 0; i--)
+    printf "  in d%d(x%d + 1) end\n", i + 1, i;
+  print "in";
+  print "  print_int(d0(0)); print(\"\\n\")";
+  print "end";
+}
+
+function variables(   i) {
+  print "let";
+  print "  function main(): int =";
+  print "    let";
+  for (i = 0; i < n; i++)
+    printf "      var v%d := %d\n", i, i;
+  print "      function bump() = (";
+  for (i = 0; i < n; i++)
+    printf "        v%d := v%d + 1%s\n", i, i, i < n - 1 ? ";" : ")";
+  print "    in";
+  printf "      bump(); v0 + v%d\n", n - 1;
+  print "    end";
+  print "in";
+  print "  print_int(main()); print(\"\\n\")";
+  print "end";
+}
+
+function sequence(   i) {
+  print "let";
+  print "  var x := 0";
+  print "in";
+  print "  (";
+  for (i = 0; i < n; i++)
+    printf "    x := x + %d;\n", i % 10;
+  print "    print_int(x); print(\"\\n\")";
+  print "  )";
+  print "end";
+}
+
+# The literal is built by doubling, and cut at its size.
+function string(   literal) {
+  literal = "abcdefghijklmnopqrstuvwxyz";
+  while (length(literal) < n)
+    literal = literal literal;
+  print "let";
+  printf "  var s := \"%s\"\n", substr(literal, 1, n);
+  print "in";
+  print "  print_int(size(s)); print(\"\\n\")";
+  print "end";
+}
+
+BEGIN {
+  printf "/* Generated by generate.sh %s %d. */\n", kind, n;
+  if (kind == "functions") functions();
+  else if (kind == "siblings") siblings();
+  else if (kind == "depth") depth();
+  else if (kind == "variables") variables();
+  else if (kind == "sequence") sequence();
+  else string();
+}'
@@ -0,0 +1,24 @@
+# Plot a table made by scale.sh: the time and the growth of the peak
+# memory of every phase against the size, on logarithmic scales.
+#
+# Usage: gnuplot -e "data='scale-depth.dat'; output='scale-depth.svg'" scale.gp
+
+phases = "parse bind type-check irgen"
+
+set terminal svg size 1000,450
+set output output
+set multiplot layout 1,2 title data noenhanced
+set logscale xy
+set key top left noenhanced
+set xlabel "size"
+
+set ylabel "time (us)"
+plot for [i=0:3] data using 1:(column(3 + 2 * i)) \
+       with linespoints title word(phases, i + 1), \
+     data using 1:11 with linespoints title "total"
+
+set ylabel "memory (kB)"
+plot for [i=0:3] data using 1:(column(4 + 2 * i)) \
+       with linespoints title word(phases, i + 1)
+
+unset multiplot
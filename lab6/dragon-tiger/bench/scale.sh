@@ -0,0 +1,103 @@
+#! /bin/sh
+#
+# Measure how the front end and the IR generator of dtiger scale with
+# the size of their input, on programs made by generate.sh.
+#
+# Usage: scale.sh dtiger kind [size...]
+#
+# For every size, a program of the given kind is generated and
+# compiled up to the IR generation. The output is a table with one
+# line per size, which gnuplot reads directly: the size, the size of
+# the source in bytes, then the time in microseconds and the growth of
+# the peak memory in kB of the parse, bind, type-check and irgen
+# phases, and the total time of all the phases. It ends with the
+# growth exponent of the time of every phase of the trace and of the
+# total, the slope of its log-log regression against the size: about 1
+# for a linear phase, 2 or more for the super-linear ones.
+
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $(basename "$0") dtiger kind [size...]" 1>&2
+  exit 1
+fi
+
+dtiger="$1"
+kind="$2"
+shift 2
+
+if [ $# -eq 0 ]; then
+  case "$kind" in
+    functions|variables) set -- 1000 2000 4000 8000 16000 32000 ;;
+    siblings) set -- 250 500 1000 2000 4000 ;;
+    depth) set -- 25 50 100 200 400 ;;
+    sequence|string) set -- 31250 62500 125000 250000 500000 1000000 ;;
+  esac
+fi
+
+generate="$(dirname "$0")/generate.sh"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+
+echo "# $kind"
+echo "# size bytes parse_us parse_kb bind_us bind_kb type-check_us" \
+     "type-check_kb irgen_us irgen_kb total_us"
+
+for size in "$@"; do
+  echo "$kind $size" 1>&2
+  sh "$generate" "$kind" "$size" > "$work/program.tig"
+  "$dtiger" -i --trace-passes "$work/trace.json" "$work/program.tig"
+  bytes="$(wc -c < "$work/program.tig" | tr -d ' ')"
+  # One phase per line of the trace: size bytes name duration rss.
+  sed -n 's/.*"name":"\([^"]*\)".*"dur":\([0-9.]*\).*"rss_kb":\([0-9-]*\).*/\1 \2 \3/p' \
+      "$work/trace.json" | sed "s/^/$size $bytes /"
+done > "$work/phases"
+
+awk '
+  function row() {
+    printf "%d %d", size, bytes;
+    for (p = 1; p <= 4; p++)
+      printf " %.0f %d", time[shown[p]], rss[shown[p]];
+    printf " %.0f\n", total;
+  }
+  BEGIN { split("parse bind type-check irgen", shown, " ") }
+  $1 != size {
+    if (NR > 1)
+      row();
+    size = $1; bytes = $2; total = 0;
+    delete time; delete rss;
+  }
+  { time[$3] = $4; rss[$3] = $5; total += $4 }
+  END { if (NR > 0) row() }' "$work/phases"
+
+# The slope of the least squares regression of log(time) against
+# log(size), for every phase and for the total.
+awk '
+  function point(phase, x, y) {
+    if (y <= 0)
+      return;
+    if (!(phase in n))
+      names[++count] = phase;
+    n[phase]++; sx[phase] += x; sy[phase] += y;
+    sxx[phase] += x * x; sxy[phase] += x * y;
+  }
+  function total_point() {
+    if (size)
+      point("total", log(size), log(total));
+  }
+  $1 != size { total_point(); size = $1; total = 0 }
+  { point($3, log($1), log($4)); total += $4 }
+  END {
+    total_point();
+    printf "# growth exponents:";
+    for (i = 1; i <= count; i++) {
+      phase = names[i];
+      d = n[phase] * sxx[phase] - sx[phase] * sx[phase];
+      if (n[phase] < 2 || d == 0)
+        printf " %s -", phase;
+      else
+        printf " %s %.2f", phase,
+               (n[phase] * sxy[phase] - sx[phase] * sy[phase]) / d;
+    }
+    printf "\n";
+  }' "$work/phases"
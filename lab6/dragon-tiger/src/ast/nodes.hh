@@ -164,6 +164,8 @@ public:
   // Public fields
   const Symbol name;
   int depth = -1;
+  // Dense identifier given by opt::Numberer, for side tables
+  int id = -1;
 
   // Constructor
   Decl(const location &_loc, const Symbol &_name) : Node(_loc), name(_name) {}
@@ -175,6 +177,14 @@ public:
   }
   int &get_depth() { return depth; }
   const int &get_depth() const { return depth; }
+
+  // Setter and getters for field `id'
+  void set_id(int _id) {
+    assert(_id >= 0);
+    id = _id;
+  }
+  int &get_id() { return id; }
+  const int &get_id() const { return id; }
 };
 
 class IntegerLiteral : public Expr {
@@ -246,6 +256,12 @@ public:
   Expr &get_right() { return *right; }
   const Expr &get_right() const { return *right; }
 
+  // Owning pointer for field `left', for passes rewriting the AST
+  Expr *&get_left_ptr() { return left; }
+
+  // Owning pointer for field `right', for passes rewriting the AST
+  Expr *&get_right_ptr() { return right; }
+
   // Acceptor method for visitors
   virtual void accept(ASTVisitor &visitor) { visitor.visit(*this); }
   virtual void accept(ConstASTVisitor &visitor) const { visitor.visit(*this); }
@@ -408,6 +424,15 @@ public:
   Expr &get_else_part() { return *else_part; }
   const Expr &get_else_part() const { return *else_part; }
 
+  // Owning pointer for field `condition', for passes rewriting the AST
+  Expr *&get_condition_ptr() { return condition; }
+
+  // Owning pointer for field `then_part', for passes rewriting the AST
+  Expr *&get_then_part_ptr() { return then_part; }
+
+  // Owning pointer for field `else_part', for passes rewriting the AST
+  Expr *&get_else_part_ptr() { return else_part; }
+
   // Acceptor method for visitors
   virtual void accept(ASTVisitor &visitor) { visitor.visit(*this); }
   virtual void accept(ConstASTVisitor &visitor) const { visitor.visit(*this); }
@@ -456,6 +481,9 @@ public:
   bool &get_escapes() { return escapes; }
   const bool &get_escapes() const { return escapes; }
 
+  // Owning pointer for field `expr', for passes rewriting the AST
+  Expr *&get_expr_ptr() { return expr; }
+
   // Acceptor method for visitors
   virtual void accept(ASTVisitor &visitor) { visitor.visit(*this); }
   virtual void accept(ConstASTVisitor &visitor) const { visitor.visit(*this); }
@@ -541,6 +569,9 @@ public:
     return escaping_decls;
   }
 
+  // Owning pointer for field `expr', for passes rewriting the AST
+  Expr *&get_expr_ptr() { return expr; }
+
   // Acceptor method for visitors
   virtual void accept(ASTVisitor &visitor) { visitor.visit(*this); }
   virtual void accept(ConstASTVisitor &visitor) const { visitor.visit(*this); }
@@ -644,6 +675,12 @@ public:
   Expr &get_body() { return *body; }
   const Expr &get_body() const { return *body; }
 
+  // Owning pointer for field `condition', for passes rewriting the AST
+  Expr *&get_condition_ptr() { return condition; }
+
+  // Owning pointer for field `body', for passes rewriting the AST
+  Expr *&get_body_ptr() { return body; }
+
   // Acceptor method for visitors
   virtual void accept(ASTVisitor &visitor) { visitor.visit(*this); }
   virtual void accept(ConstASTVisitor &visitor) const { visitor.visit(*this); }
@@ -686,6 +723,12 @@ public:
   Expr &get_body() { return *body; }
   const Expr &get_body() const { return *body; }
 
+  // Owning pointer for field `high', for passes rewriting the AST
+  Expr *&get_high_ptr() { return high; }
+
+  // Owning pointer for field `body', for passes rewriting the AST
+  Expr *&get_body_ptr() { return body; }
+
   // Acceptor method for visitors
   virtual void accept(ASTVisitor &visitor) { visitor.visit(*this); }
   virtual void accept(ConstASTVisitor &visitor) const { visitor.visit(*this); }
@@ -758,6 +801,9 @@ public:
   Expr &get_rhs() { return *rhs; }
   const Expr &get_rhs() const { return *rhs; }
 
+  // Owning pointer for field `rhs', for passes rewriting the AST
+  Expr *&get_rhs_ptr() { return rhs; }
+
   // Acceptor method for visitors
   virtual void accept(ASTVisitor &visitor) { visitor.visit(*this); }
   virtual void accept(ConstASTVisitor &visitor) const { visitor.visit(*this); }
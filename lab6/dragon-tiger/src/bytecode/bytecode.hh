@@ -0,0 +1,119 @@
+#ifndef BYTECODE_HH
+#define BYTECODE_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Runtime string objects.
+struct tiger_string;
+
+namespace bytecode {
+
+// Instructions of the stack machine. Operands are given in the
+// instruction `a' and `b' fields. A "slot" designates a variable
+// in a frame, slot 0 always holding the static link. The `b' field
+// of calls is the stack map of the call site, used by the garbage
+// collector.
+//
+//   op_const a          push integer a
+//   op_string a         push string constant a
+//   op_load a           push slot a of the current frame
+//   op_store a          pop into slot a of the current frame
+//   op_load_up a b      push slot b of the frame a levels up
+//   op_store_up a b     pop into slot b of the frame a levels up
+//   op_link a           push the frame a levels up, as a static link
+//   op_pop a            drop a values
+//   op_add ... op_ge    replace two integers by the operation result
+//   op_strcmp           replace two strings by their comparison
+//   op_jump a           continue at instruction a
+//   op_jump_if_zero a   pop, and continue at instruction a if zero
+//   op_call a b         call function a, whose static link and
+//                       arguments are on top of the stack
+//   op_call_prim a b    call runtime primitive a
+//   op_ret              return the value on top of the stack
+//   op_ret_void         return from a void function
+#define BYTECODE_OPCODES(X)                                                    \
+  X(op_const)                                                                  \
+  X(op_string)                                                                 \
+  X(op_load)                                                                   \
+  X(op_store)                                                                  \
+  X(op_load_up)                                                                \
+  X(op_store_up)                                                               \
+  X(op_link)                                                                   \
+  X(op_pop)                                                                    \
+  X(op_add)                                                                    \
+  X(op_sub)                                                                    \
+  X(op_mul)                                                                    \
+  X(op_div)                                                                    \
+  X(op_eq)                                                                     \
+  X(op_neq)                                                                    \
+  X(op_lt)                                                                     \
+  X(op_le)                                                                     \
+  X(op_gt)                                                                     \
+  X(op_ge)                                                                     \
+  X(op_strcmp)                                                                 \
+  X(op_jump)                                                                   \
+  X(op_jump_if_zero)                                                           \
+  X(op_call)                                                                   \
+  X(op_call_prim)                                                              \
+  X(op_ret)                                                                    \
+  X(op_ret_void)
+
+#define BYTECODE_ENUM(name) name,
+typedef enum : uint8_t { BYTECODE_OPCODES(BYTECODE_ENUM) } Opcode;
+#undef BYTECODE_ENUM
+
+// Runtime primitives, with their external name, in the same
+// order as their declaration in the runtime.
+#define BYTECODE_PRIMITIVES(X)                                                 \
+  X(p_print_err, "__print_err")                                                \
+  X(p_print, "__print")                                                        \
+  X(p_print_int, "__print_int")                                                \
+  X(p_flush, "__flush")                                                        \
+  X(p_getchar, "__getchar")                                                    \
+  X(p_ord, "__ord")                                                            \
+  X(p_chr, "__chr")                                                            \
+  X(p_size, "__size")                                                          \
+  X(p_substring, "__substring")                                                \
+  X(p_concat, "__concat")                                                      \
+  X(p_strcmp, "__strcmp")                                                      \
+  X(p_streq, "__streq")                                                        \
+  X(p_not, "__not")                                                            \
+  X(p_exit, "__exit")
+
+#define BYTECODE_ENUM(name, external_name) name,
+typedef enum : uint8_t { BYTECODE_PRIMITIVES(BYTECODE_ENUM) } Primitive;
+#undef BYTECODE_ENUM
+
+struct Instruction {
+  Opcode op;
+  int32_t a;
+  int32_t b;
+};
+
+struct Function {
+  std::string name;
+  // Number of parameters, stored in slots 1 to params.
+  int32_t params = 0;
+  // Number of slots in the frame, including the static link.
+  int32_t slots = 1;
+  // Maximum number of temporaries on top of the frame.
+  int32_t max_stack = 0;
+  std::vector<Instruction> code;
+  // Slots holding strings, in increasing order.
+  std::vector<int32_t> string_slots;
+  // Positions of the strings among the temporaries during a call,
+  // not counting the call static link and arguments.
+  std::vector<std::vector<int32_t>> stack_maps;
+};
+
+struct Program {
+  std::vector<Function> functions;
+  std::vector<const tiger_string *> strings;
+  int32_t main = -1;
+};
+
+} // namespace bytecode
+
+#endif // BYTECODE_HH
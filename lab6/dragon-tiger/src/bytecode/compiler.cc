@@ -0,0 +1,320 @@
+#include <algorithm>
+
+#include "compiler.hh"
+#include "../runtime/posix/runtime.h"
+#include "../utils/errors.hh"
+
+using utils::error;
+
+namespace bytecode {
+
+#define BYTECODE_NAME(name, external_name) external_name,
+static const char *const primitive_names[] = {
+    BYTECODE_PRIMITIVES(BYTECODE_NAME)};
+#undef BYTECODE_NAME
+
+// Opcodes of the binary operators, in the order of ast::Operator.
+static const Opcode binary_opcodes[] = {op_add, op_sub, op_mul, op_div,
+                                        op_eq,  op_neq, op_lt,  op_le,
+                                        op_gt,  op_ge};
+
+static int32_t primitive(const FunDecl &decl) {
+  const std::string &name = decl.get_external_name().get();
+  for (size_t p = 0; p < sizeof(primitive_names) / sizeof(*primitive_names);
+       p++)
+    if (name == primitive_names[p])
+      return p;
+  error(decl.loc, "unknown primitive " + name);
+}
+
+// Whether an instruction other than a call leaves a result on top of
+// the stack.
+static bool has_result(Opcode op) {
+  switch (op) {
+  case op_store:
+  case op_store_up:
+  case op_pop:
+  case op_jump:
+  case op_jump_if_zero:
+  case op_call:
+  case op_call_prim:
+  case op_ret:
+  case op_ret_void:
+    return false;
+  default:
+    return true;
+  }
+}
+
+size_t Compiler::emit(Opcode op, int32_t effect, int32_t a, int32_t b) {
+  Function &function = program.functions[current_function];
+  function.code.push_back(Instruction{op, a, b});
+  temporaries.resize(temporaries.size() + effect, false);
+  // The result may take the place of a string operand. It is an
+  // integer unless push_string() is called next.
+  if (has_result(op))
+    temporaries.back() = false;
+  function.max_stack =
+      std::max(function.max_stack, int32_t(temporaries.size()));
+  return function.code.size() - 1;
+}
+
+void Compiler::push_string() { temporaries.back() = true; }
+
+int32_t Compiler::stack_map(size_t height) {
+  Function &function = program.functions[current_function];
+  std::vector<int32_t> strings;
+  for (size_t t = 0; t < height; t++)
+    if (temporaries[t])
+      strings.push_back(t);
+  function.stack_maps.push_back(std::move(strings));
+  return function.stack_maps.size() - 1;
+}
+
+int32_t Compiler::here() const {
+  return program.functions[current_function].code.size();
+}
+
+void Compiler::patch(size_t jump) {
+  program.functions[current_function].code[jump].a = here();
+}
+
+int32_t Compiler::new_slot() {
+  return program.functions[current_function].slots++;
+}
+
+int32_t Compiler::new_slot(const VarDecl &decl) {
+  const int32_t slot = new_slot();
+  slots[&decl] = slot;
+  if (decl.get_type() == t_string)
+    program.functions[current_function].string_slots.push_back(slot);
+  return slot;
+}
+
+int32_t Compiler::get_function(const FunDecl &decl) {
+  auto index = function_index.find(&decl);
+  if (index != function_index.end())
+    return index->second;
+
+  const int32_t new_index = program.functions.size();
+  program.functions.push_back(Function());
+  program.functions.back().name = decl.get_external_name().get();
+  function_index[&decl] = new_index;
+  pending_func_bodies.push_front(&decl);
+  return new_index;
+}
+
+Program Compiler::compile_program(const FunDecl &main) {
+  program.main = get_function(main);
+
+  while (!pending_func_bodies.empty()) {
+    compile_function(*pending_func_bodies.back());
+    pending_func_bodies.pop_back();
+  }
+
+  return std::move(program);
+}
+
+void Compiler::compile_function(const FunDecl &decl) {
+  current_function = get_function(decl);
+  temporaries.clear();
+
+  // Parameters are stored by the caller right above the static link.
+  program.functions[current_function].params = decl.get_params().size();
+  for (auto param : decl.get_params())
+    new_slot(*param);
+
+  decl.get_expr()->accept(*this);
+
+  if (decl.get_type() == t_void)
+    emit(op_ret_void, 0);
+  else
+    emit(op_ret, -1);
+}
+
+void Compiler::access(const Identifier &id, Opcode local, Opcode up,
+                      int32_t effect) {
+  const VarDecl &decl = id.get_decl().get();
+  auto slot = slots.find(&decl);
+  assert(slot != slots.end());
+  const int levels = id.get_depth() - decl.get_depth();
+  if (levels == 0)
+    emit(local, effect, slot->second);
+  else
+    emit(up, effect, levels, slot->second);
+}
+
+void Compiler::visit(const IntegerLiteral &literal) {
+  emit(op_const, 1, literal.value);
+}
+
+void Compiler::visit(const StringLiteral &literal) {
+  const std::string &value = literal.value.get();
+  program.strings.push_back(__make_string(value.data(), value.size()));
+  emit(op_string, 1, program.strings.size() - 1);
+  push_string();
+}
+
+void Compiler::visit(const BinaryOperator &op) {
+  op.get_left().accept(*this);
+  op.get_right().accept(*this);
+
+  // Void values can be compared for equality only.
+  if (op.get_left().get_type() == t_void) {
+    emit(op_const, 1, op.op == o_eq);
+    return;
+  }
+
+  if (op.get_left().get_type() == t_string) {
+    emit(op_strcmp, -1);
+    emit(op_const, 1, 0);
+  }
+
+  emit(binary_opcodes[op.op], -1);
+}
+
+void Compiler::visit(const Sequence &seq) {
+  const std::vector<Expr *> &exprs = seq.get_exprs();
+  for (size_t i = 0; i < exprs.size(); i++) {
+    exprs[i]->accept(*this);
+    // Only the value of the last expression is kept.
+    if (i + 1 < exprs.size() && exprs[i]->get_type() != t_void)
+      emit(op_pop, -1, 1);
+  }
+}
+
+void Compiler::visit(const Let &let) {
+  for (auto decl : let.get_decls())
+    decl->accept(*this);
+
+  let.get_sequence().accept(*this);
+}
+
+void Compiler::visit(const Identifier &id) {
+  if (id.get_type() == t_void)
+    return;
+  access(id, op_load, op_load_up, 1);
+  if (id.get_type() == t_string)
+    push_string();
+}
+
+void Compiler::visit(const IfThenElse &ite) {
+  ite.get_condition().accept(*this);
+  const size_t to_else = emit(op_jump_if_zero, -1);
+  const size_t branch_height = temporaries.size();
+
+  ite.get_then_part().accept(*this);
+  const size_t to_end = emit(op_jump, 0);
+
+  // Only one of the branches is executed: the else part starts
+  // with the same stack as the then part.
+  temporaries.resize(branch_height);
+  patch(to_else);
+  ite.get_else_part().accept(*this);
+  patch(to_end);
+}
+
+void Compiler::visit(const VarDecl &decl) {
+  if (decl.get_type() == t_void) {
+    if (decl.get_expr())
+      decl.get_expr()->accept(*this);
+    return;
+  }
+
+  const int32_t slot = new_slot(decl);
+  decl.get_expr()->accept(*this);
+  emit(op_store, -1, slot);
+}
+
+void Compiler::visit(const FunDecl &decl) {
+  // Function bodies are compiled when the function is first called.
+}
+
+void Compiler::visit(const FunCall &call) {
+  const FunDecl &decl = call.get_decl().get();
+  const int32_t args = call.get_args().size();
+  const int32_t result = decl.get_type() == t_void ? 0 : 1;
+
+  if (decl.is_external && !decl.get_expr()) {
+    for (auto expr : call.get_args())
+      expr->accept(*this);
+    emit(op_call_prim, result - args, primitive(decl),
+         stack_map(temporaries.size() - args));
+  } else {
+    const int32_t index = get_function(decl);
+    emit(op_link, 1, call.get_depth() - decl.get_depth());
+    for (auto expr : call.get_args())
+      expr->accept(*this);
+    emit(op_call, result - args - 1, index,
+         stack_map(temporaries.size() - args - 1));
+  }
+
+  // The result takes the place of the static link or of an argument.
+  if (result)
+    temporaries.back() = decl.get_type() == t_string;
+}
+
+void Compiler::visit(const WhileLoop &loop) {
+  loop_heights[&loop] = temporaries.size();
+
+  const int32_t test = here();
+  loop.get_condition().accept(*this);
+  const size_t to_end = emit(op_jump_if_zero, -1);
+
+  loop.get_body().accept(*this);
+  emit(op_jump, 0, test);
+
+  patch(to_end);
+  for (size_t jump : loop_exits[&loop])
+    patch(jump);
+}
+
+void Compiler::visit(const ForLoop &loop) {
+  loop.get_variable().accept(*this);
+  const int32_t index = slots[&loop.get_variable()];
+
+  // The upper bound is evaluated only once.
+  const int32_t high = new_slot();
+  loop.get_high().accept(*this);
+  emit(op_store, -1, high);
+
+  loop_heights[&loop] = temporaries.size();
+
+  const int32_t test = here();
+  emit(op_load, 1, index);
+  emit(op_load, 1, high);
+  emit(op_le, -1);
+  const size_t to_end = emit(op_jump_if_zero, -1);
+
+  loop.get_body().accept(*this);
+  emit(op_load, 1, index);
+  emit(op_const, 1, 1);
+  emit(op_add, -1);
+  emit(op_store, -1, index);
+  emit(op_jump, 0, test);
+
+  patch(to_end);
+  for (size_t jump : loop_exits[&loop])
+    patch(jump);
+}
+
+void Compiler::visit(const Break &b) {
+  const Loop &loop = b.get_loop().get();
+
+  // Drop the temporaries pushed since the loop started. The code
+  // following the break is unreachable, so the static height
+  // is left unchanged for it.
+  const int32_t extra = temporaries.size() - loop_heights[&loop];
+  if (extra > 0)
+    emit(op_pop, 0, extra);
+  loop_exits[&loop].push_back(emit(op_jump, 0));
+}
+
+void Compiler::visit(const Assign &assign) {
+  assign.get_rhs().accept(*this);
+  if (assign.get_lhs().get_type() == t_void)
+    return;
+  access(assign.get_lhs(), op_store, op_store_up, -1);
+}
+
+} // namespace bytecode
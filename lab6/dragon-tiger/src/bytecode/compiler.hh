@@ -0,0 +1,93 @@
+#ifndef BYTECODE_COMPILER_HH
+#define BYTECODE_COMPILER_HH
+
+#include <deque>
+#include <unordered_map>
+
+#include "../ast/nodes.hh"
+#include "bytecode.hh"
+
+namespace bytecode {
+using namespace ast::types;
+
+// Translate a bound, escaped and type-checked program into bytecode.
+// Every expression pushes exactly one value on the stack, unless its
+// type is void in which case it pushes nothing.
+class Compiler : public ConstASTVisitor {
+  Program program;
+
+  // Index of the function being compiled.
+  int32_t current_function;
+
+  // Static contents of the temporaries stack at the current point
+  // of the current function: whether each temporary is a string.
+  std::vector<bool> temporaries;
+
+  // Slot of every variable in the frame of its function.
+  std::unordered_map<const VarDecl *, int32_t> slots;
+
+  // Index of every function in the program.
+  std::unordered_map<const FunDecl *, int32_t> function_index;
+
+  // Stack height at loop entry, and jumps to patch with the
+  // loop exit once it is known.
+  std::unordered_map<const Loop *, int32_t> loop_heights;
+  std::unordered_map<const Loop *, std::vector<size_t>> loop_exits;
+
+  // Functions whose body remain to be compiled, processed one
+  // at a time as in the IR generator.
+  std::deque<const FunDecl *> pending_func_bodies;
+
+  // Append an instruction to the current function, and return
+  // its position. `effect' is its effect on the stack height.
+  size_t emit(Opcode op, int32_t effect, int32_t a = 0, int32_t b = 0);
+
+  // Record that the temporary on top of the stack is a string.
+  void push_string();
+
+  // Record the strings among the `height' bottom temporaries as
+  // a stack map of the current function, and return its index.
+  int32_t stack_map(size_t height);
+
+  // Position of the next instruction to emit.
+  int32_t here() const;
+
+  // Point the jump at position `jump' to the next instruction.
+  void patch(size_t jump);
+
+  // Allocate a new slot in the current frame, for a variable
+  // or for a compiler temporary.
+  int32_t new_slot();
+  int32_t new_slot(const VarDecl &decl);
+
+  // Return the index of a function, registering it and queueing
+  // its body for compilation the first time it is seen.
+  int32_t get_function(const FunDecl &decl);
+  void compile_function(const FunDecl &decl);
+
+  // Emit a load or a store of a variable from an identifier.
+  void access(const Identifier &id, Opcode local, Opcode up, int32_t effect);
+
+public:
+  // Compile the whole program, given its main function declaration.
+  Program compile_program(const FunDecl &main);
+
+  virtual void visit(const IntegerLiteral &);
+  virtual void visit(const StringLiteral &);
+  virtual void visit(const BinaryOperator &);
+  virtual void visit(const Sequence &);
+  virtual void visit(const Let &);
+  virtual void visit(const Identifier &);
+  virtual void visit(const IfThenElse &);
+  virtual void visit(const VarDecl &);
+  virtual void visit(const FunDecl &);
+  virtual void visit(const FunCall &);
+  virtual void visit(const WhileLoop &);
+  virtual void visit(const ForLoop &);
+  virtual void visit(const Break &);
+  virtual void visit(const Assign &);
+};
+
+} // namespace bytecode
+
+#endif // BYTECODE_COMPILER_HH
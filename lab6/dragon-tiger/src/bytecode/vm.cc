@@ -0,0 +1,279 @@
+#include "vm.hh"
+#include "../runtime/posix/runtime.h"
+#include "../utils/errors.hh"
+
+// The dispatch loop is threaded through computed gotos,
+// which are a GNU extension.
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+using utils::error;
+
+namespace bytecode {
+
+namespace {
+
+// Follow the static links from a frame.
+inline Value *up(Value *frame, int32_t levels) {
+  while (levels--)
+    frame = frame[0].frame;
+  return frame;
+}
+
+// Integer arithmetic wraps around as in the generated native code.
+inline int32_t wrap(uint32_t value) { return static_cast<int32_t>(value); }
+
+// String slots which are not parameters are cleared on function
+// entry, as they are garbage collector roots from the start.
+inline void clear_strings(const Function &function, Value *fp) {
+  for (int32_t slot : function.string_slots)
+    if (slot > function.params)
+      fp[slot].s = nullptr;
+}
+
+} // namespace
+
+VM::VM(size_t _stack_size)
+    : stack(new Value[_stack_size]), stack_size(_stack_size) {}
+
+void VM::mark(const Activation &activation) {
+  const Function &function = *activation.function;
+  for (int32_t slot : function.string_slots)
+    __gc_mark(activation.fp[slot].s);
+  for (int32_t position : function.stack_maps[activation.pc[-1].b])
+    __gc_mark(activation.fp[function.slots + position].s);
+}
+
+void VM::scan(void *vm) {
+  const VM &machine = *static_cast<const VM *>(vm);
+  mark(machine.current);
+  for (const Activation &caller : machine.calls)
+    mark(caller);
+}
+
+int32_t VM::run(const Program &program) {
+#define BYTECODE_LABEL(name) &&do_##name,
+  static void *const dispatch_table[] = {BYTECODE_OPCODES(BYTECODE_LABEL)};
+#undef BYTECODE_LABEL
+
+  Value *const stack_end = stack.get() + stack_size;
+
+  const Function *function = &program.functions[program.main];
+  Value *fp = stack.get();
+  if (fp + function->slots + function->max_stack > stack_end)
+    error("stack overflow");
+  fp[0].frame = nullptr;
+  clear_strings(*function, fp);
+  Value *sp = fp + function->slots;
+
+  calls.clear();
+  __gc_set_scanner(scan, this);
+
+  const Instruction *code = function->code.data();
+  const Instruction *pc = code;
+  const Instruction *i;
+
+#define DISPATCH() goto *dispatch_table[(i = pc++)->op]
+
+  DISPATCH();
+
+do_op_const:
+  (sp++)->i = i->a;
+  DISPATCH();
+
+do_op_string:
+  (sp++)->s = program.strings[i->a];
+  DISPATCH();
+
+do_op_load:
+  *sp++ = fp[i->a];
+  DISPATCH();
+
+do_op_store:
+  fp[i->a] = *--sp;
+  DISPATCH();
+
+do_op_load_up:
+  *sp++ = up(fp, i->a)[i->b];
+  DISPATCH();
+
+do_op_store_up:
+  up(fp, i->a)[i->b] = *--sp;
+  DISPATCH();
+
+do_op_link:
+  (sp++)->frame = up(fp, i->a);
+  DISPATCH();
+
+do_op_pop:
+  sp -= i->a;
+  DISPATCH();
+
+do_op_add:
+  sp--;
+  sp[-1].i = wrap(uint32_t(sp[-1].i) + uint32_t(sp[0].i));
+  DISPATCH();
+
+do_op_sub:
+  sp--;
+  sp[-1].i = wrap(uint32_t(sp[-1].i) - uint32_t(sp[0].i));
+  DISPATCH();
+
+do_op_mul:
+  sp--;
+  sp[-1].i = wrap(uint32_t(sp[-1].i) * uint32_t(sp[0].i));
+  DISPATCH();
+
+do_op_div:
+  sp--;
+  if (sp[0].i == 0)
+    error("division by zero");
+  sp[-1].i = sp[-1].i / sp[0].i;
+  DISPATCH();
+
+do_op_eq:
+  sp--;
+  sp[-1].i = sp[-1].i == sp[0].i;
+  DISPATCH();
+
+do_op_neq:
+  sp--;
+  sp[-1].i = sp[-1].i != sp[0].i;
+  DISPATCH();
+
+do_op_lt:
+  sp--;
+  sp[-1].i = sp[-1].i < sp[0].i;
+  DISPATCH();
+
+do_op_le:
+  sp--;
+  sp[-1].i = sp[-1].i <= sp[0].i;
+  DISPATCH();
+
+do_op_gt:
+  sp--;
+  sp[-1].i = sp[-1].i > sp[0].i;
+  DISPATCH();
+
+do_op_ge:
+  sp--;
+  sp[-1].i = sp[-1].i >= sp[0].i;
+  DISPATCH();
+
+do_op_strcmp:
+  sp--;
+  sp[-1].i = __strcmp(sp[-1].s, sp[0].s);
+  DISPATCH();
+
+do_op_jump:
+  pc = code + i->a;
+  DISPATCH();
+
+do_op_jump_if_zero:
+  if ((--sp)->i == 0)
+    pc = code + i->a;
+  DISPATCH();
+
+do_op_call: {
+  const Function &callee = program.functions[i->a];
+  Value *const callee_fp = sp - (callee.params + 1);
+  if (callee_fp + callee.slots + callee.max_stack > stack_end)
+    error("stack overflow");
+  calls.push_back(Activation{function, pc, fp});
+  function = &callee;
+  fp = callee_fp;
+  clear_strings(callee, fp);
+  sp = fp + callee.slots;
+  code = pc = callee.code.data();
+  DISPATCH();
+}
+
+do_op_call_prim:
+  // Only the primitives building strings may collect garbage, they
+  // keep their own arguments alive.
+  switch (i->a) {
+  case p_print_err:
+    __print_err((--sp)->s);
+    break;
+  case p_print:
+    __print((--sp)->s);
+    break;
+  case p_print_int:
+    __print_int((--sp)->i);
+    break;
+  case p_flush:
+    __flush();
+    break;
+  case p_getchar:
+    (sp++)->s = __getchar();
+    break;
+  case p_ord:
+    sp[-1].i = __ord(sp[-1].s);
+    break;
+  case p_chr:
+    sp[-1].s = __chr(sp[-1].i);
+    break;
+  case p_size:
+    sp[-1].i = __size(sp[-1].s);
+    break;
+  case p_substring:
+    current = Activation{function, pc, fp};
+    sp -= 2;
+    sp[-1].s = __substring(sp[-1].s, sp[0].i, sp[1].i);
+    break;
+  case p_concat:
+    current = Activation{function, pc, fp};
+    sp--;
+    sp[-1].s = __concat(sp[-1].s, sp[0].s);
+    break;
+  case p_strcmp:
+    sp--;
+    sp[-1].i = __strcmp(sp[-1].s, sp[0].s);
+    break;
+  case p_streq:
+    sp--;
+    sp[-1].i = __streq(sp[-1].s, sp[0].s);
+    break;
+  case p_not:
+    sp[-1].i = __not(sp[-1].i);
+    break;
+  case p_exit:
+    __exit((--sp)->i);
+  default:
+    assert(false); __builtin_unreachable();
+  }
+  DISPATCH();
+
+do_op_ret: {
+  const Value result = sp[-1];
+  if (calls.empty()) {
+    __gc_set_scanner(nullptr, nullptr);
+    return result.i;
+  }
+  sp = fp;
+  *sp++ = result;
+  function = calls.back().function;
+  code = function->code.data();
+  pc = calls.back().pc;
+  fp = calls.back().fp;
+  calls.pop_back();
+  DISPATCH();
+}
+
+do_op_ret_void:
+  if (calls.empty()) {
+    __gc_set_scanner(nullptr, nullptr);
+    return 0;
+  }
+  sp = fp;
+  function = calls.back().function;
+  code = function->code.data();
+  pc = calls.back().pc;
+  fp = calls.back().fp;
+  calls.pop_back();
+  DISPATCH();
+
+#undef DISPATCH
+}
+
+} // namespace bytecode
@@ -0,0 +1,52 @@
+#ifndef BYTECODE_VM_HH
+#define BYTECODE_VM_HH
+
+#include <memory>
+#include <vector>
+
+#include "bytecode.hh"
+
+namespace bytecode {
+
+// A stack cell: an integer, a string, or a static link.
+union Value {
+  int32_t i;
+  const tiger_string *s;
+  Value *frame;
+};
+
+// Bytecode interpreter. Frames and temporaries share a single stack:
+// a frame starts with its static link and parameters, pushed by the
+// caller, followed by the other variables and the temporaries.
+class VM {
+  std::unique_ptr<Value[]> stack;
+  const size_t stack_size;
+
+  // State of a function while it calls another function or a
+  // primitive: pc follows the call instruction.
+  struct Activation {
+    const Function *function;
+    const Instruction *pc;
+    Value *fp;
+  };
+
+  // Suspended callers, and the running function when it calls a
+  // primitive which may trigger a garbage collection.
+  std::vector<Activation> calls;
+  Activation current;
+
+  // Report the strings of the machine to the garbage collector.
+  static void scan(void *vm);
+  static void mark(const Activation &);
+
+public:
+  explicit VM(size_t _stack_size = 1 << 20);
+
+  // Run the main function of the program and return its result.
+  // A call to the exit primitive leaves the process directly.
+  int32_t run(const Program &);
+};
+
+} // namespace bytecode
+
+#endif // BYTECODE_VM_HH
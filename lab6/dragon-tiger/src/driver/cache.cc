@@ -0,0 +1,196 @@
+#include <cstdio>
+#include <utime.h>
+
+#include "cache.hh"
+
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/SHA1.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace driver {
+
+// Objects are named after their key. The prefix is the one which
+// llvm::pruneCache expects, temporary files do not have it.
+static const char object_prefix[] = "llvmcache-";
+static const char stats_file[] = "stats";
+static const char compiler_file[] = "compiler";
+
+CompilationCache::CompilationCache(const std::string &_directory,
+                                   uint64_t _max_size,
+                                   const std::string &compiler)
+    : directory(_directory), max_size(_max_size) {
+  llvm::sys::fs::create_directories(directory);
+  compiler_stamp = compiler_stamp_of(compiler);
+}
+
+std::string CompilationCache::default_directory() {
+  llvm::SmallString<128> directory;
+  if (!llvm::sys::path::cache_directory(directory))
+    llvm::sys::fs::current_path(directory);
+  llvm::sys::path::append(directory, "dtiger");
+  return directory.str().str();
+}
+
+// A file is identified by the hash of its content, so that a rebuilt
+// compiler or runtime never reuses the objects of the previous one.
+std::string CompilationCache::stamp(const std::string &file) {
+  auto contents = llvm::MemoryBuffer::getFile(file);
+  if (!contents)
+    return file + ":missing";
+  llvm::SHA1 hash;
+  hash.update((*contents)->getBuffer());
+  return file + ":" + llvm::toHex(hash.final(), true);
+}
+
+// The compiler is large, so its stamp is kept in the directory with
+// the identity of the file it was computed from: its device and inode,
+// its size and its modification time in nanoseconds. Installing or
+// relinking the compiler changes at least one of them.
+std::string CompilationCache::compiler_stamp_of(const std::string &compiler) {
+  llvm::sys::fs::file_status status;
+  if (llvm::sys::fs::status(compiler, status))
+    return compiler + ":missing";
+  const llvm::sys::fs::UniqueID id = status.getUniqueID();
+  const auto modified =
+      status.getLastModificationTime().time_since_epoch().count();
+  const std::string identity =
+      compiler + " " + std::to_string(id.getDevice()) + " " +
+      std::to_string(id.getFile()) + " " + std::to_string(status.getSize()) +
+      " " + std::to_string(modified);
+
+  llvm::SmallString<128> memo(directory);
+  llvm::sys::path::append(memo, compiler_file);
+  if (auto previous = llvm::MemoryBuffer::getFile(memo)) {
+    llvm::StringRef line = (*previous)->getBuffer();
+    if (line.consume_front(identity + "\n"))
+      return line.rtrim("\n").str();
+  }
+
+  // As objects, the stamp is written to a temporary file first.
+  const std::string result = stamp(compiler);
+  int fd;
+  llvm::SmallString<128> temporary(directory);
+  llvm::sys::path::append(temporary, "tmp-%%%%%%%%");
+  if (llvm::sys::fs::createUniqueFile(temporary, fd, temporary))
+    return result;
+  {
+    llvm::raw_fd_ostream out(fd, true);
+    out << identity << "\n" << result << "\n";
+  }
+  if (llvm::sys::fs::rename(temporary, memo))
+    llvm::sys::fs::remove(temporary);
+  return result;
+}
+
+std::string CompilationCache::key(const std::string &source_file,
+                                  const std::string &options) const {
+  auto source = llvm::MemoryBuffer::getFile(source_file);
+  if (!source)
+    return "";
+
+  // Fields are separated by NUL bytes, which none of them holds
+  // except the source, which comes last.
+  llvm::SHA1 hash;
+  hash.update(compiler_stamp);
+  hash.update(llvm::StringRef("", 1));
+  hash.update(options);
+  hash.update(llvm::StringRef("", 1));
+  hash.update((*source)->getBuffer());
+  return llvm::toHex(hash.final(), true);
+}
+
+std::string CompilationCache::path(const std::string &key) const {
+  llvm::SmallString<128> file(directory);
+  llvm::sys::path::append(file, object_prefix + key + ".o");
+  return file.str().str();
+}
+
+std::unique_ptr<llvm::MemoryBuffer>
+CompilationCache::lookup(const std::string &key) {
+  auto object = llvm::MemoryBuffer::getFile(path(key));
+  count(bool(object));
+  if (!object)
+    return nullptr;
+  // Eviction removes the objects which were used least recently.
+  utime(path(key).c_str(), nullptr);
+  return std::move(*object);
+}
+
+void CompilationCache::store(const std::string &key, llvm::StringRef object) {
+  // Objects appear atomically, so that concurrent compilations never
+  // see a partial one.
+  int fd;
+  llvm::SmallString<128> temporary(directory);
+  llvm::sys::path::append(temporary, "tmp-%%%%%%%%.o");
+  if (llvm::sys::fs::createUniqueFile(temporary, fd, temporary))
+    return;
+  {
+    llvm::raw_fd_ostream out(fd, true);
+    out << object;
+  }
+  if (llvm::sys::fs::rename(temporary, path(key))) {
+    llvm::sys::fs::remove(temporary);
+    return;
+  }
+
+  llvm::CachePruningPolicy policy;
+  policy.Interval = std::chrono::seconds(0);
+  policy.Expiration = std::chrono::seconds(0);
+  policy.MaxSizePercentageOfAvailableSpace = 0;
+  policy.MaxSizeBytes = max_size;
+  policy.MaxSizeFiles = 0;
+  llvm::pruneCache(directory, policy);
+}
+
+// Counters are kept in a small text file, "hits misses". Concurrent
+// compilations may lose counts, they are only statistics.
+std::string CompilationCache::stats_path() const {
+  llvm::SmallString<128> file(directory);
+  llvm::sys::path::append(file, stats_file);
+  return file.str().str();
+}
+
+void CompilationCache::read_stats(unsigned long long &hits,
+                                  unsigned long long &misses) const {
+  hits = misses = 0;
+  if (auto stats = llvm::MemoryBuffer::getFile(stats_path()))
+    std::sscanf((*stats)->getBuffer().str().c_str(), "%llu %llu", &hits,
+                &misses);
+}
+
+void CompilationCache::count(bool hit) {
+  unsigned long long hits, misses;
+  read_stats(hits, misses);
+  (hit ? hits : misses)++;
+
+  std::error_code error;
+  llvm::raw_fd_ostream out(stats_path(), error, llvm::sys::fs::F_Text);
+  if (!error)
+    out << hits << " " << misses << "\n";
+}
+
+void CompilationCache::print_stats(std::ostream &ostream) const {
+  unsigned long long hits, misses;
+  read_stats(hits, misses);
+
+  uint64_t objects = 0, size = 0;
+  std::error_code error;
+  for (llvm::sys::fs::directory_iterator entry(directory, error), end;
+       !error && entry != end; entry.increment(error)) {
+    if (!llvm::sys::path::filename(entry->path()).startswith(object_prefix))
+      continue;
+    llvm::sys::fs::file_status status;
+    if (!llvm::sys::fs::status(entry->path(), status)) {
+      objects++;
+      size += status.getSize();
+    }
+  }
+
+  ostream << "cache " << directory << ": " << hits << " hits, " << misses
+          << " misses, " << objects << " objects, " << size << " bytes\n";
+}
+
+} // namespace driver
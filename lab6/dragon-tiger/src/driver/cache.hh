@@ -0,0 +1,78 @@
+#ifndef CACHE_HH
+#define CACHE_HH
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+namespace driver {
+
+// Directory of object files compiled by dtiger, so that unchanged
+// programs are not compiled again. An object is found by a key
+// hashing the source, the compiler itself and the options which
+// change the generated code. The least recently used objects are
+// removed once the directory grows over its maximum size. Hits and
+// misses are counted across runs.
+class CompilationCache {
+  const std::string directory;
+  const uint64_t max_size;
+  // Hash of the compiler executable.
+  std::string compiler_stamp;
+
+  std::string compiler_stamp_of(const std::string &compiler);
+  std::string path(const std::string &key) const;
+  std::string stats_path() const;
+  void read_stats(unsigned long long &hits, unsigned long long &misses) const;
+  void count(bool hit);
+
+public:
+  CompilationCache(const std::string &directory, uint64_t max_size,
+                   const std::string &compiler);
+
+  // Default directory, in the user cache directory.
+  static std::string default_directory();
+
+  // Key of the compilation of a source file with the given options,
+  // or an empty string if the source cannot be read. Files whose
+  // content matters, such as the runtime bitcode, can be given as
+  // options through stamp(), which hashes them.
+  std::string key(const std::string &source_file,
+                  const std::string &options) const;
+  static std::string stamp(const std::string &file);
+
+  // Object cached for the key, or nullptr. Counts a hit or a miss.
+  std::unique_ptr<llvm::MemoryBuffer> lookup(const std::string &key);
+
+  // Cache an object, then evict old objects if needed.
+  void store(const std::string &key, llvm::StringRef object);
+
+  void print_stats(std::ostream &ostream) const;
+};
+
+// Store the object compiled by the JIT for a program under its key.
+// Lookups are done before the program is even parsed, so the JIT
+// never gets an object from here.
+class JITObjectCache : public llvm::ObjectCache {
+  CompilationCache &cache;
+  const std::string key;
+
+public:
+  JITObjectCache(CompilationCache &_cache, const std::string &_key)
+      : cache(_cache), key(_key) {}
+
+  void notifyObjectCompiled(const llvm::Module *,
+                            llvm::MemoryBufferRef object) override {
+    cache.store(key, object.getBuffer());
+  }
+  std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *) override {
+    return nullptr;
+  }
+};
+
+} // namespace driver
+
+#endif // CACHE_HH
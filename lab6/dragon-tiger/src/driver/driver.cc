@@ -1,16 +1,145 @@
+#include <algorithm>
 #include <boost/program_options.hpp>
+#include <functional>
 #include <iostream>
+#include <sstream>
+#include <thread>
 
 #include "../ast/ast_dumper.hh"
 #include "../ast/binder.hh"
 #include "../ast/escaper.hh"
 #include "../ast/type_checker.hh"
+#include "../bytecode/compiler.hh"
+#include "../bytecode/vm.hh"
+#include "../opt/constant_folder.hh"
+#include "../opt/inliner.hh"
+#include "../opt/lambda_lifter.hh"
+#include "../opt/numberer.hh"
 #include "../parser/parser_driver.hh"
 #include "../irgen/irgen.hh"
 #include "../utils/errors.hh"
+#include "cache.hh"
+#include "passes.hh"
+
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Pass.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/raw_ostream.h"
+
+// Run the C compiler with args, without going through the shell.
+// TIGER_CC may carry options after the name of the program. Returns
+// false and sets message on failure.
+static bool run_compiler(const std::vector<std::string> &args,
+                         std::string &message) {
+  std::vector<std::string> command;
+  std::istringstream words(TIGER_CC);
+  for (std::string word; words >> word;)
+    command.push_back(word);
+  if (command.empty()) {
+    message = "no C compiler";
+    return false;
+  }
+  const llvm::ErrorOr<std::string> program =
+      llvm::sys::findProgramByName(command[0]);
+  if (!program) {
+    message = "cannot find " + command[0] + ": " +
+              program.getError().message();
+    return false;
+  }
+  command.insert(command.end(), args.begin(), args.end());
+  const std::vector<llvm::StringRef> argv(command.begin(), command.end());
+  if (llvm::sys::ExecuteAndWait(*program, argv, llvm::None, {}, 0, 0,
+                                &message) != 0) {
+    if (message.empty())
+      message = command[0] + " failed";
+    return false;
+  }
+  return true;
+}
+
+// Link an object file with the Tiger runtime into an executable.
+static void link_executable(const std::string &object,
+                            const std::string &output) {
+  std::string message;
+  if (!run_compiler({"-Wl,--gc-sections", "-o", output, object,
+                     TIGER_RUNTIME},
+                    message))
+    utils::error("cannot link " + output + ": " + message);
+}
+
+// The processor the JIT compiles for: its name and, in a stable order,
+// the features it has or lacks.
+static std::string host_cpu() {
+  std::string result = llvm::sys::getHostCPUName().str();
+  llvm::StringMap<bool> features;
+  if (llvm::sys::getHostCPUFeatures(features)) {
+    std::vector<std::string> names;
+    for (const auto &feature : features)
+      names.push_back((feature.second ? "+" : "-") + feature.first().str());
+    std::sort(names.begin(), names.end());
+    for (const std::string &name : names)
+      result += "," + name;
+  }
+  return result;
+}
+
+static bool is_object_file(const std::string &name) {
+  return name.size() > 2 && name.compare(name.size() - 2, 2, ".o") == 0;
+}
+
+// Write an object file with emit, and link it into an executable
+// unless the output is the object file itself.
+static void
+write_output(const std::function<void(const std::string &)> &emit,
+             const std::string &output) {
+  if (is_object_file(output)) {
+    emit(output);
+    return;
+  }
+  llvm::SmallString<128> object;
+  if (llvm::sys::fs::createTemporaryFile("dtiger", "o", object))
+    utils::error("cannot create temporary object file");
+  emit(object.c_str());
+  link_executable(object.c_str(), output);
+  llvm::sys::fs::remove(object);
+}
+
+// Combine the objects of the partitions of a program, in order, into
+// a single relocatable object file.
+static void link_partitions(const std::vector<std::string> &objects,
+                            const std::string &output) {
+  std::vector<llvm::SmallString<128>> files(objects.size());
+  std::vector<std::string> args = {"-r", "-nostdlib", "-o", output};
+  for (size_t i = 0; i < objects.size(); i++) {
+    if (llvm::sys::fs::createTemporaryFile("dtiger", "o", files[i]))
+      utils::error("cannot create temporary object file");
+    std::error_code error;
+    llvm::raw_fd_ostream out(files[i], error, llvm::sys::fs::F_None);
+    if (error)
+      utils::error("cannot open " + files[i].str().str() + ": " +
+                   error.message());
+    out << objects[i];
+    args.push_back(files[i].str().str());
+  }
+  std::string message;
+  const bool linked = run_compiler(args, message);
+  for (const llvm::SmallString<128> &file : files)
+    llvm::sys::fs::remove(file);
+  if (!linked)
+    utils::error("cannot link " + output + ": " + message);
+}
 
 int main(int argc, char **argv) {
   std::string output_file;
+  unsigned opt_level = 0;
+  unsigned inline_threshold = opt::Inliner::default_threshold;
+  std::string cache_dir = driver::CompilationCache::default_directory();
+  uint64_t cache_size = 256;
+  unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+  std::string trace_file;
   std::vector<std::string> input_files;
   namespace po = boost::program_options;
   po::options_description options("Options");
@@ -21,6 +150,28 @@ int main(int argc, char **argv) {
   ("bind,b", "run the binder on the parsed AST")
   ("type,t", "run the type checker on the parsed AST")
   ("irgen,i", "run the LLVM IR code generator")
+  ("eval,e", "run the program with the bytecode interpreter")
+  ("opt-level,O", po::value(&opt_level), "optimization level (0 to 3)")
+  ("no-fold", "do not fold constant expressions in the AST")
+  ("no-lift", "keep the static links of all nested functions")
+  ("no-link-runtime", "do not optimize the runtime bitcode with the program")
+  ("inline-threshold", po::value(&inline_threshold),
+   "inline functions up to this size in the AST (0 to disable)")
+  ("output,o", po::value(&output_file),
+   "write an object file (file.o) or a linked executable")
+  ("run", "run the program in-process with the JIT compiler")
+  ("jobs,j", po::value(&jobs),
+   "threads optimizing and emitting large programs (one per core by default)")
+  ("cache", "reuse the object of an unchanged program from the cache")
+  ("cache-dir", po::value(&cache_dir), "directory of the cache")
+  ("cache-size", po::value(&cache_size),
+   "maximum size of the cache in megabytes (256 by default)")
+  ("cache-stats", "print the cache statistics on the standard error")
+  ("time-passes", "print the time spent in each phase and each LLVM pass")
+  ("mem-stats",
+   "print the memory used and the size of the program after each phase")
+  ("trace-passes", po::value(&trace_file),
+   "write the phases as a Chrome trace to this JSON file")
   ("trace-parser", "enable parser traces")
   ("trace-lexer", "enable lexer traces")
   ("verbose,v", "be verbose")
@@ -46,42 +197,260 @@ int main(int argc, char **argv) {
     utils::error("usage: dtiger [options] input-file");
   }
 
-  ParserDriver parser_driver = ParserDriver(vm.count("trace-lexer"), vm.count("trace-parser"));
+  if (opt_level > 3) {
+    utils::error("optimization level must be between 0 and 3");
+  }
 
-  if (!parser_driver.parse(input_files[0])) {
-    utils::error("parser failed");
+  if (jobs == 0) {
+    utils::error("the number of jobs must be positive");
   }
 
+  const bool irgen =
+      vm.count("irgen") || vm.count("output") || vm.count("run");
+  const bool eval = vm.count("eval");
+  const bool run = vm.count("run");
+  // The JIT only resolves the runtime primitives linked into dtiger,
+  // not the C library the runtime bitcode calls, so the program it runs
+  // is not linked with the runtime. The bitcode is only built when
+  // configure found tools matching the LLVM of dtiger.
+  const bool link_runtime = TIGER_LINK_RUNTIME && vm.count("opt-level") &&
+                            opt_level > 0 && !run &&
+                            !vm.count("no-link-runtime");
+
+  // The object of an unchanged program comes from the cache, before
+  // the program is even parsed. Only the compilations which produce
+  // nothing but an object file, an executable or a run are cached.
+  std::unique_ptr<driver::CompilationCache> cache;
+  std::string cache_key;
+  if (vm.count("cache") && run != !output_file.empty() && !eval &&
+      !vm.count("dump-ast") && !vm.count("dump-ir") && input_files[0] != "-") {
+    cache.reset(new driver::CompilationCache(
+        cache_dir, cache_size << 20,
+        llvm::sys::fs::getMainExecutable(
+            argv[0], reinterpret_cast<void *>(&is_object_file))));
+
+    // Objects compiled by the JIT are not position independent, and
+    // differ from the ones written to files. They also use every
+    // feature of the processor they were compiled on, while objects
+    // written to files target a generic one.
+    std::ostringstream options;
+    options << (run ? "jit" : "object") << " -O"
+            << (vm.count("opt-level") ? std::to_string(opt_level) : "none")
+            << " fold=" << !vm.count("no-fold")
+            << " lift=" << !vm.count("no-lift")
+            << " inline=" << inline_threshold;
+    if (run)
+      options << " cpu=" << host_cpu();
+    if (link_runtime)
+      options << " " << driver::CompilationCache::stamp(TIGER_RUNTIME_BC);
+    cache_key = cache->key(input_files[0], options.str());
+
+    if (!cache_key.empty()) {
+      if (std::unique_ptr<llvm::MemoryBuffer> object =
+              cache->lookup(cache_key)) {
+        int status = 0;
+        if (run) {
+          status = irgen::run_object(std::move(object));
+        } else {
+          write_output(
+              [&object](const std::string &file) {
+                std::error_code error;
+                llvm::raw_fd_ostream out(file, error, llvm::sys::fs::F_None);
+                if (error)
+                  utils::error("cannot open " + file + ": " + error.message());
+                out << object->getBuffer();
+              },
+              output_file);
+        }
+        if (vm.count("cache-stats"))
+          cache->print_stats(std::cerr);
+        return status;
+      }
+    } else {
+      cache.reset();
+    }
+  }
+
+  ParserDriver parser_driver = ParserDriver(vm.count("trace-lexer"), vm.count("trace-parser"));
   FunDecl *main = nullptr;
-  if (vm.count("bind") || vm.count("type") || vm.count("irgen")) {
-    ast::binder::Binder binder;
-    main = binder.analyze_program(*parser_driver.result_ast);
-    ast::escaper::Escaper escaper;
-    main->accept(escaper);
+  opt::LambdaLifter lifter;
+  std::unique_ptr<irgen::IRGenerator> ir_generator;
+  bool parallel = false;
+  int status = 0;
+
+  const bool analyze = vm.count("bind") || vm.count("type") || irgen || eval;
+  const bool time_passes = vm.count("time-passes");
+  const bool mem_stats = vm.count("mem-stats");
+  llvm::TimePassesIsEnabled = time_passes;
+
+  // The phases of the compilation, measured by the pass manager. The
+  // size of the program is sampled after each of them.
+  driver::PassManager passes(mem_stats || !trace_file.empty());
+  passes.add_counter("nodes", [&]() -> uint64_t {
+    if (main)
+      return driver::count_nodes(*main);
+    return driver::count_nodes(*parser_driver.result_ast);
+  });
+  passes.add_counter("symbols", []() -> uint64_t {
+    return utils::Symbol::count();
+  });
+  passes.add_counter("instructions", [&]() -> uint64_t {
+    return ir_generator ? ir_generator->instruction_count() : 0;
+  });
+
+  passes.add("parse", [&] {
+    if (!parser_driver.parse(input_files[0])) {
+      utils::error("parser failed");
+    }
+  });
+
+  if (analyze) {
+    passes.add("bind", [&] {
+      ast::binder::Binder binder;
+      main = binder.analyze_program(*parser_driver.result_ast);
+      // The binder leaves main, which is not declared in the program,
+      // without a depth. Its variables are at depth 1.
+      main->set_depth(0);
+      opt::Numberer().number_program(*main);
+    });
+  }
+
+  if (vm.count("type") || irgen || eval) {
+    passes.add("type-check", [&] {
+      ast::type_checker::TypeChecker type_checker;
+      main->accept(type_checker);
+    });
+  }
+
+  // Folding and inlining change the code, so escapes are computed on
+  // their result.
+  if ((irgen || eval) && !vm.count("no-fold")) {
+    passes.add("fold", [&] {
+      opt::ConstantFolder folder;
+      main->accept(folder);
+    });
   }
 
-  if (vm.count("type") || vm.count("irgen")) {
-    ast::type_checker::TypeChecker type_checker;
-    main->accept(type_checker);
+  if (irgen || eval) {
+    passes.add("inline", [&] {
+      opt::Inliner inliner(inline_threshold);
+      inliner.inline_program(*main);
+      // Removed functions and copied bodies leave the ids sparse.
+      opt::Numberer().number_program(*main);
+    });
   }
 
-  if (vm.count("irgen")) {
-    irgen::IRGenerator ir_generator;
-    ir_generator.generate_program(main);
+  if (analyze) {
+    passes.add("escape", [&] {
+      ast::escaper::Escaper escaper;
+      main->accept(escaper);
+    });
+  }
+
+  if (irgen) {
+    // Lifting only changes escapes, which the bytecode compiler ignores.
+    if (!vm.count("no-lift")) {
+      passes.add("lift", [&] { lifter.analyze_program(*main); });
+    }
+
+    passes.add("irgen", [&] {
+      ir_generator.reset(
+          new irgen::IRGenerator(vm.count("no-lift") ? nullptr : &lifter));
+      ir_generator->generate_program(main);
+
+      // Large programs written to a file are split, then optimized and
+      // emitted in parallel. The partitions only depend on the program,
+      // so the object does not depend on the number of jobs.
+      parallel = !output_file.empty() && !run && !vm.count("dump-ir") &&
+                 ir_generator->partition_count() > 1;
+    });
+
+    if (link_runtime) {
+      passes.add("link-runtime",
+                 [&] { ir_generator->link_runtime(TIGER_RUNTIME_BC); });
+    }
+
+    // Parallel partitions are optimized while they are emitted.
+    if (vm.count("opt-level")) {
+      passes.add("optimize", [&] {
+        if (!parallel)
+          ir_generator->optimize(opt_level);
+      });
+    }
 
     if (vm.count("dump-ir")) {
-      ir_generator.print_ir(&std::cout);
+      passes.add("dump-ir", [&] { ir_generator->print_ir(&std::cout); });
+    }
+
+    if (!output_file.empty()) {
+      passes.add("emit", [&] {
+        write_output(
+            [&](const std::string &file) {
+              if (parallel)
+                link_partitions(
+                    ir_generator->emit_partitions(
+                        vm.count("opt-level") ? int(opt_level) : -1, jobs),
+                    file);
+              else
+                ir_generator->emit_object(file);
+              if (cache)
+                if (auto object = llvm::MemoryBuffer::getFile(file))
+                  cache->store(cache_key, (*object)->getBuffer());
+            },
+            output_file);
+      });
+    }
+
+    if (run) {
+      passes.add("run", [&] {
+        std::unique_ptr<driver::JITObjectCache> jit_cache;
+        if (cache)
+          jit_cache.reset(new driver::JITObjectCache(*cache, cache_key));
+        status = ir_generator->run(jit_cache.get());
+      });
     }
   }
 
+  if (eval) {
+    passes.add("eval", [&] {
+      bytecode::Compiler compiler;
+      bytecode::VM machine;
+      status = machine.run(compiler.compile_program(*main));
+    });
+  }
+
   if (vm.count("dump-ast")) {
-    ast::ASTDumper dumper(&std::cout, vm.count("verbose") > 0);
-    if (main)
-      main->accept(dumper);
-    else
-      parser_driver.result_ast->accept(dumper);
-    dumper.nl();
+    passes.add("dump-ast", [&] {
+      ast::ASTDumper dumper(&std::cout, vm.count("verbose") > 0);
+      if (main)
+        main->accept(dumper);
+      else
+        parser_driver.result_ast->accept(dumper);
+      dumper.nl();
+    });
   }
-  delete parser_driver.result_ast;
-  return 0;
+
+  passes.run();
+
+  if (cache && vm.count("cache-stats"))
+    cache->print_stats(std::cerr);
+
+  if (time_passes || mem_stats) {
+    passes.print_report(std::cerr, time_passes, mem_stats);
+  }
+  if (time_passes) {
+    llvm::reportAndResetTimings(&llvm::errs());
+  }
+  if (!trace_file.empty()) {
+    passes.write_trace(trace_file);
+  }
+
+  // Passes may have replaced the root of the program, which is then
+  // only owned by main.
+  ir_generator.reset();
+  if (main)
+    delete main;
+  else
+    delete parser_driver.result_ast;
+  return status;
 }
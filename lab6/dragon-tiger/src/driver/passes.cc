@@ -0,0 +1,208 @@
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <sys/resource.h>
+
+#include "passes.hh"
+#include "../utils/errors.hh"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+namespace driver {
+using namespace ast::types;
+
+namespace {
+
+double cpu_time() {
+  return 1e6 * std::clock() / CLOCKS_PER_SEC;
+}
+
+// Peak resident set size so far, in kilobytes on Linux.
+long peak_rss() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+class NodeCounter : public ConstASTVisitor {
+public:
+  uint64_t count = 0;
+
+  virtual void visit(const IntegerLiteral &) { count++; }
+  virtual void visit(const StringLiteral &) { count++; }
+  virtual void visit(const BinaryOperator &op) {
+    count++;
+    op.get_left().accept(*this);
+    op.get_right().accept(*this);
+  }
+  virtual void visit(const Sequence &seq) {
+    count++;
+    for (const Expr *expr : seq.get_exprs())
+      expr->accept(*this);
+  }
+  virtual void visit(const Let &let) {
+    count++;
+    for (const Decl *decl : let.get_decls())
+      decl->accept(*this);
+    let.get_sequence().accept(*this);
+  }
+  virtual void visit(const Identifier &) { count++; }
+  virtual void visit(const IfThenElse &ite) {
+    count++;
+    ite.get_condition().accept(*this);
+    ite.get_then_part().accept(*this);
+    ite.get_else_part().accept(*this);
+  }
+  virtual void visit(const VarDecl &decl) {
+    count++;
+    if (auto expr = decl.get_expr())
+      expr->accept(*this);
+  }
+  virtual void visit(const FunDecl &decl) {
+    count++;
+    for (const VarDecl *param : decl.get_params())
+      param->accept(*this);
+    if (auto expr = decl.get_expr())
+      expr->accept(*this);
+  }
+  virtual void visit(const FunCall &call) {
+    count++;
+    for (const Expr *arg : call.get_args())
+      arg->accept(*this);
+  }
+  virtual void visit(const WhileLoop &loop) {
+    count++;
+    loop.get_condition().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const ForLoop &loop) {
+    count++;
+    loop.get_variable().accept(*this);
+    loop.get_high().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const Break &) { count++; }
+  virtual void visit(const Assign &assign) {
+    count++;
+    assign.get_lhs().accept(*this);
+    assign.get_rhs().accept(*this);
+  }
+};
+
+} // namespace
+
+PassManager::PassManager(bool _sample_counters)
+    : sample_counters(_sample_counters) {}
+
+void PassManager::add(const std::string &name, Pass pass) {
+  passes.emplace_back(name, std::move(pass));
+}
+
+void PassManager::add_counter(const std::string &name, Counter counter) {
+  counters.emplace_back(name, std::move(counter));
+}
+
+void PassManager::run() {
+  typedef std::chrono::steady_clock clock;
+  const clock::time_point origin = clock::now();
+  for (auto &pass : passes) {
+    const clock::time_point start = clock::now();
+    const double cpu_start = cpu_time();
+    const long rss_start = peak_rss();
+    pass.second();
+
+    Measure measure;
+    measure.name = pass.first;
+    measure.start =
+        std::chrono::duration<double, std::micro>(start - origin).count();
+    measure.wall =
+        std::chrono::duration<double, std::micro>(clock::now() - start).count();
+    measure.cpu = cpu_time() - cpu_start;
+    measure.rss = peak_rss() - rss_start;
+    if (sample_counters)
+      for (auto &counter : counters)
+        measure.counts.push_back(counter.second());
+    measures.push_back(measure);
+  }
+}
+
+void PassManager::print_report(std::ostream &ostream, bool times,
+                               bool memory) const {
+  const std::ios::fmtflags flags = ostream.flags();
+  const std::streamsize precision = ostream.precision();
+  ostream << std::fixed << std::setprecision(3);
+
+  ostream << std::left << std::setw(16) << "phase" << std::right;
+  if (times)
+    ostream << std::setw(12) << "wall (ms)" << std::setw(12) << "cpu (ms)";
+  if (memory) {
+    ostream << std::setw(12) << "rss (kB)";
+    if (sample_counters)
+      for (auto &counter : counters)
+        ostream << std::setw(14) << counter.first;
+  }
+  ostream << "\n";
+
+  double total_wall = 0, total_cpu = 0;
+  long total_rss = 0;
+  for (const Measure &measure : measures) {
+    ostream << std::left << std::setw(16) << measure.name << std::right;
+    if (times)
+      ostream << std::setw(12) << measure.wall / 1000 << std::setw(12)
+              << measure.cpu / 1000;
+    if (memory) {
+      ostream << std::setw(12) << "+" + std::to_string(measure.rss);
+      for (uint64_t count : measure.counts)
+        ostream << std::setw(14) << count;
+    }
+    ostream << "\n";
+    total_wall += measure.wall;
+    total_cpu += measure.cpu;
+    total_rss += measure.rss;
+  }
+
+  ostream << std::left << std::setw(16) << "total" << std::right;
+  if (times)
+    ostream << std::setw(12) << total_wall / 1000 << std::setw(12)
+            << total_cpu / 1000;
+  if (memory)
+    ostream << std::setw(12) << "+" + std::to_string(total_rss);
+  ostream << "\n";
+
+  ostream.flags(flags);
+  ostream.precision(precision);
+}
+
+// Phases are complete events of the trace event format, with their
+// measures as arguments. Names need no escaping.
+void PassManager::write_trace(const std::string &file) const {
+  std::error_code error;
+  llvm::raw_fd_ostream out(file, error, llvm::sys::fs::F_Text);
+  if (error)
+    utils::error("cannot open " + file + ": " + error.message());
+
+  out << "{\"traceEvents\":[";
+  for (size_t i = 0; i < measures.size(); i++) {
+    const Measure &measure = measures[i];
+    out << (i ? ",\n" : "\n") << "{\"name\":\"" << measure.name
+        << "\",\"cat\":\"phase\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+        << ",\"ts\":" << llvm::format("%.3f", measure.start)
+        << ",\"dur\":" << llvm::format("%.3f", measure.wall)
+        << ",\"args\":{\"cpu_us\":" << llvm::format("%.3f", measure.cpu)
+        << ",\"rss_kb\":" << measure.rss;
+    for (size_t c = 0; c < measure.counts.size(); c++)
+      out << ",\"" << counters[c].first << "\":" << measure.counts[c];
+    out << "}}";
+  }
+  out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+}
+
+uint64_t count_nodes(const ast::Node &root) {
+  NodeCounter counter;
+  root.accept(counter);
+  return counter.count;
+}
+
+} // namespace driver
@@ -0,0 +1,56 @@
+#ifndef PASSES_HH
+#define PASSES_HH
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "../ast/nodes.hh"
+
+namespace driver {
+
+// PassManager runs the phases of a compilation in the order they were
+// added, and measures each of them: wall and CPU time, growth of the
+// peak resident set size, and counters sampled once the phase is done,
+// such as the number of AST nodes. Measures are printed as a table, or
+// written as a Chrome trace (see chrome://tracing).
+class PassManager {
+public:
+  typedef std::function<void()> Pass;
+  typedef std::function<uint64_t()> Counter;
+
+  // Counters may be costly, they are only sampled if requested.
+  explicit PassManager(bool sample_counters);
+
+  void add(const std::string &name, Pass pass);
+  void add_counter(const std::string &name, Counter counter);
+  void run();
+
+  // Print the times and/or the memory statistics of every phase.
+  void print_report(std::ostream &ostream, bool times, bool memory) const;
+  void write_trace(const std::string &file) const;
+
+private:
+  struct Measure {
+    std::string name;
+    // Times in microseconds, from the start of the first phase.
+    double start, wall, cpu;
+    // Growth of the peak resident set size, in kilobytes.
+    long rss;
+    std::vector<uint64_t> counts;
+  };
+
+  const bool sample_counters;
+  std::vector<std::pair<std::string, Pass>> passes;
+  std::vector<std::pair<std::string, Counter>> counters;
+  std::vector<Measure> measures;
+};
+
+// Number of AST nodes reachable from a node, for statistics.
+uint64_t count_nodes(const ast::Node &root);
+
+} // namespace driver
+
+#endif // PASSES_HH
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "irgen.hh"
+#include "../utils/errors.hh"
+
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/Internalize.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+using utils::error;
+
+namespace irgen {
+
+static llvm::CodeGenOpt::Level codegen_opt_level(unsigned level) {
+  switch (level) {
+  case 0:
+    return llvm::CodeGenOpt::None;
+  case 1:
+    return llvm::CodeGenOpt::Less;
+  case 2:
+    return llvm::CodeGenOpt::Default;
+  default:
+    return llvm::CodeGenOpt::Aggressive;
+  }
+}
+
+// Create a target machine for the host. The native target must have
+// been initialized. Returns nullptr and sets message on failure, as
+// this runs on the emitting threads.
+static std::unique_ptr<llvm::TargetMachine>
+create_target_machine(unsigned level, std::string &message) {
+  const std::string triple = llvm::sys::getDefaultTargetTriple();
+  const llvm::Target *target =
+      llvm::TargetRegistry::lookupTarget(triple, message);
+  if (!target) {
+    message = "cannot find target " + triple + ": " + message;
+    return nullptr;
+  }
+
+  // Same settings as the former "llc -relocation-model=pic" invocation.
+  llvm::TargetOptions options;
+  return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+      triple, "generic", "", options, llvm::Reloc::PIC_, llvm::None,
+      codegen_opt_level(level)));
+}
+
+// Mimic "opt -O<level>": the same pipeline as the command line tool,
+// with the inliner thresholds it would have used.
+static void optimize_module(llvm::Module &M, llvm::TargetMachine *TM,
+                            unsigned level) {
+  llvm::PassManagerBuilder builder;
+  builder.OptLevel = level;
+  builder.SizeLevel = 0;
+  if (level > 1)
+    builder.Inliner = llvm::createFunctionInliningPass(level, 0, false);
+  else
+    builder.Inliner = llvm::createAlwaysInlinerLegacyPass();
+  builder.LoopVectorize = level > 1;
+  builder.SLPVectorize = level > 1;
+  TM->adjustPassManager(builder);
+
+  llvm::legacy::FunctionPassManager function_passes(&M);
+  function_passes.add(
+      llvm::createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+  builder.populateFunctionPassManager(function_passes);
+
+  llvm::legacy::PassManager module_passes;
+  module_passes.add(
+      llvm::createTargetTransformInfoWrapperPass(TM->getTargetIRAnalysis()));
+  builder.populateModulePassManager(module_passes);
+
+  function_passes.doInitialization();
+  for (llvm::Function &F : M)
+    function_passes.run(F);
+  function_passes.doFinalization();
+
+  module_passes.run(M);
+}
+
+// Returns false if the target cannot emit object files.
+static bool emit_module(llvm::Module &M, llvm::TargetMachine *TM,
+                        llvm::raw_pwrite_stream &dest) {
+  llvm::legacy::PassManager passes;
+  if (TM->addPassesToEmitFile(passes, dest, nullptr,
+                              llvm::TargetMachine::CGFT_ObjectFile))
+    return false;
+  passes.run(M);
+  return true;
+}
+
+llvm::TargetMachine *IRGenerator::target_machine() {
+  if (Target)
+    return Target.get();
+
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  std::string message;
+  Target = create_target_machine(opt_level, message);
+  if (!Target)
+    error(message);
+
+  Mod->setTargetTriple(Target->getTargetTriple().str());
+  Mod->setDataLayout(Target->createDataLayout());
+  return Target.get();
+}
+
+void IRGenerator::link_runtime(const std::string &filename) {
+  target_machine();
+
+  llvm::SMDiagnostic diagnostic;
+  std::unique_ptr<llvm::Module> runtime =
+      llvm::parseIRFile(filename, diagnostic, Context);
+  if (!runtime)
+    error("cannot read runtime " + filename + ": " +
+          diagnostic.getMessage().str());
+  runtime->setTargetTriple(Mod->getTargetTriple());
+
+  // Only the runtime definitions used by the program, and the ones
+  // they use, are linked. They become internal, so that they can be
+  // inlined, specialized or removed like the program functions.
+  if (llvm::Linker::linkModules(
+          *Mod, std::move(runtime), llvm::Linker::Flags::LinkOnlyNeeded,
+          [](llvm::Module &M, const llvm::StringSet<> &linked) {
+            llvm::internalizeModule(M, [&linked](const llvm::GlobalValue &GV) {
+              return !GV.hasName() || !linked.count(GV.getName());
+            });
+          }))
+    error("cannot link runtime " + filename);
+}
+
+void IRGenerator::optimize(unsigned level) {
+  opt_level = level;
+  // The target machine may have been created before the level was
+  // known, to link the runtime.
+  llvm::TargetMachine *TM = target_machine();
+  TM->setOptLevel(codegen_opt_level(level));
+  optimize_module(*Mod, TM, level);
+}
+
+void IRGenerator::emit_object(const std::string &filename) {
+  llvm::TargetMachine *TM = target_machine();
+
+  std::error_code EC;
+  llvm::raw_fd_ostream dest(filename, EC, llvm::sys::fs::F_None);
+  if (EC)
+    error("cannot open " + filename + ": " + EC.message());
+
+  if (!emit_module(*Mod, TM, dest))
+    error("target cannot emit object files");
+  dest.flush();
+}
+
+unsigned IRGenerator::partition_count() const {
+  unsigned functions = 0;
+  for (const llvm::Function &F : *Mod)
+    if (!F.isDeclaration())
+      functions++;
+  // Partitions hold at most functions_per_partition functions.
+  return std::max(1u, (functions + functions_per_partition - 1) /
+                          functions_per_partition);
+}
+
+std::vector<std::string> IRGenerator::emit_partitions(int level,
+                                                      unsigned jobs) {
+  target_machine();
+
+  // Partitions move to their own context through bitcode. Internal
+  // symbols used across partitions are made hidden, and every global
+  // goes to the partition given by the hash of its name.
+  std::vector<llvm::SmallString<0>> bitcode;
+  llvm::SplitModule(std::move(Mod), partition_count(),
+                    [&bitcode](std::unique_ptr<llvm::Module> part) {
+                      bitcode.emplace_back();
+                      llvm::raw_svector_ostream out(bitcode.back());
+                      llvm::WriteBitcodeToFile(*part, out);
+                    });
+
+  // Threads take the next partition until none is left. Objects are
+  // kept in partition order. Errors cannot be reported while other
+  // threads are inside LLVM, so they are recorded per partition, and
+  // the first one is reported once all threads are done.
+  std::vector<std::string> objects(bitcode.size());
+  std::vector<std::string> errors(bitcode.size());
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i = next++; i < bitcode.size(); i = next++) {
+      llvm::LLVMContext context;
+      auto part = llvm::parseBitcodeFile(
+          llvm::MemoryBufferRef(bitcode[i].str(), "partition"), context);
+      if (!part) {
+        errors[i] =
+            "cannot read partition: " + llvm::toString(part.takeError());
+        continue;
+      }
+      std::unique_ptr<llvm::TargetMachine> TM =
+          create_target_machine(level < 0 ? opt_level : level, errors[i]);
+      if (!TM)
+        continue;
+      if (level >= 0)
+        optimize_module(**part, TM.get(), level);
+
+      llvm::SmallString<0> object;
+      llvm::raw_svector_ostream dest(object);
+      if (!emit_module(**part, TM.get(), dest)) {
+        errors[i] = "target cannot emit object files";
+        continue;
+      }
+      objects[i] = object.str();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < std::min<size_t>(jobs, bitcode.size()); t++)
+    threads.emplace_back(worker);
+  worker();
+  for (std::thread &thread : threads)
+    thread.join();
+
+  for (const std::string &message : errors)
+    if (!message.empty())
+      error(message);
+  return objects;
+}
+
+} // namespace irgen
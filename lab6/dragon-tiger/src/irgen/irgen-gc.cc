@@ -0,0 +1,138 @@
+#include "irgen.hh"
+
+namespace irgen {
+
+namespace {
+
+// Find the strings of a function body which the garbage collector
+// must see: variables, and temporaries which are still needed while
+// other expressions, which may allocate, are evaluated. Those are
+// the left operand of a comparison and every argument of a call but
+// the last one. Literals are static and never need to be rooted.
+class RootCollector : public ConstASTVisitor {
+  std::vector<const VarDecl *> &vars;
+  std::vector<const Expr *> &temporaries;
+
+  void temporary(const Expr &expr) {
+    if (expr.get_type() == t_string &&
+        !dynamic_cast<const StringLiteral *>(&expr))
+      temporaries.push_back(&expr);
+  }
+
+public:
+  RootCollector(std::vector<const VarDecl *> &_vars,
+                std::vector<const Expr *> &_temporaries)
+      : vars(_vars), temporaries(_temporaries) {}
+
+  virtual void visit(const IntegerLiteral &) {}
+  virtual void visit(const StringLiteral &) {}
+  virtual void visit(const BinaryOperator &op) {
+    temporary(op.get_left());
+    op.get_left().accept(*this);
+    op.get_right().accept(*this);
+  }
+  virtual void visit(const Sequence &seq) {
+    for (auto expr : seq.get_exprs())
+      expr->accept(*this);
+  }
+  virtual void visit(const Let &let) {
+    for (auto decl : let.get_decls())
+      decl->accept(*this);
+    let.get_sequence().accept(*this);
+  }
+  virtual void visit(const Identifier &) {}
+  virtual void visit(const IfThenElse &ite) {
+    ite.get_condition().accept(*this);
+    ite.get_then_part().accept(*this);
+    ite.get_else_part().accept(*this);
+  }
+  virtual void visit(const VarDecl &decl) {
+    if (decl.get_type() == t_string && !decl.get_escapes())
+      vars.push_back(&decl);
+    if (decl.get_expr())
+      decl.get_expr()->accept(*this);
+  }
+  // Nested functions have their own frame.
+  virtual void visit(const FunDecl &) {}
+  virtual void visit(const FunCall &call) {
+    const std::vector<Expr *> &args = call.get_args();
+    for (size_t i = 0; i < args.size(); i++) {
+      if (i + 1 < args.size())
+        temporary(*args[i]);
+      args[i]->accept(*this);
+    }
+  }
+  virtual void visit(const WhileLoop &loop) {
+    loop.get_condition().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const ForLoop &loop) {
+    loop.get_variable().accept(*this);
+    loop.get_high().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const Break &) {}
+  virtual void visit(const Assign &assign) { assign.get_rhs().accept(*this); }
+};
+
+} // namespace
+
+void IRGenerator::collect_roots(std::vector<const VarDecl *> &vars,
+                                std::vector<const Expr *> &temporaries) {
+  RootCollector collector(vars, temporaries);
+  for (auto param : current_function_decl->get_params())
+    param->accept(collector);
+  current_function_decl->get_expr()->accept(collector);
+}
+
+void IRGenerator::push_gc_frame(const std::vector<unsigned> &roots) {
+  gc_record = nullptr;
+  if (roots.empty())
+    return;
+
+  // The frame map gives the offset of every root from the start of
+  // the frame, that is from the record.
+  llvm::StructType *const ft = entry(frame_type, *current_function_decl);
+  std::vector<llvm::Constant *> offsets;
+  for (unsigned field : roots)
+    offsets.push_back(llvm::ConstantExpr::getOffsetOf(ft, field));
+  llvm::Constant *const map = llvm::ConstantStruct::getAnon(
+      {Builder.getInt64(roots.size()),
+       llvm::ConstantArray::get(
+           llvm::ArrayType::get(Builder.getInt64Ty(), roots.size()),
+           offsets)});
+  llvm::GlobalVariable *const map_global = new llvm::GlobalVariable(
+      *Mod, map->getType(), true, llvm::GlobalValue::PrivateLinkage, map,
+      "gc_map_" + current_function_decl->get_external_name().get());
+
+  // Roots must be valid before the first collection.
+  llvm::Value *const null = llvm::ConstantPointerNull::get(
+      llvm::cast<llvm::PointerType>(llvm_type(t_string)));
+  for (unsigned field : roots)
+    Builder.CreateStore(null, Builder.CreateStructGEP(ft, frame, field));
+
+  gc_record = Builder.CreateStructGEP(ft, frame, frame_gc_field);
+  Builder.CreateStore(Builder.CreateLoad(gc_top),
+                      Builder.CreateStructGEP(gc_frame_type, gc_record, 0));
+  Builder.CreateStore(
+      Builder.CreateBitCast(map_global, Builder.getInt8PtrTy()),
+      Builder.CreateStructGEP(gc_frame_type, gc_record, 1));
+  Builder.CreateStore(gc_record, gc_top);
+}
+
+void IRGenerator::pop_gc_frame() {
+  if (gc_record)
+    Builder.CreateStore(Builder.CreateLoad(Builder.CreateStructGEP(
+                            gc_frame_type, gc_record, 0)),
+                        gc_top);
+}
+
+void IRGenerator::keep_alive(const Expr &expr, llvm::Value *value) {
+  auto root = root_position.find(&expr);
+  if (root != root_position.end())
+    Builder.CreateStore(
+        value, Builder.CreateStructGEP(entry(frame_type, *current_function_decl),
+                                       frame, root->second));
+}
+
+} // namespace irgen
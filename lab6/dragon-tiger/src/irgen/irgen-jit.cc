@@ -0,0 +1,90 @@
+#include "irgen.hh"
+#include "../runtime/posix/runtime.h"
+#include "../utils/errors.hh"
+
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Support/TargetSelect.h"
+
+using utils::error;
+
+// Address of a runtime primitive, keyed by its name in the generated code.
+#define PRIMITIVE(name) {#name, llvm::pointerToJITTargetAddress(&name)}
+
+namespace irgen {
+
+static void check(llvm::Error err, const std::string &what) {
+  if (err)
+    error(what + ": " + llvm::toString(std::move(err)));
+}
+
+// Create a JIT which knows the runtime, and gives the objects it
+// compiles to cache if there is one.
+static std::unique_ptr<llvm::orc::LLJIT> create_jit(llvm::ObjectCache *cache) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  llvm::orc::LLJITBuilder builder;
+  if (cache)
+    builder.setCompileFunctionCreator(
+        [cache](llvm::orc::JITTargetMachineBuilder JTMB)
+            -> llvm::Expected<llvm::orc::IRCompileLayer::CompileFunction> {
+          auto TM = JTMB.createTargetMachine();
+          if (!TM)
+            return TM.takeError();
+          return llvm::orc::IRCompileLayer::CompileFunction(
+              llvm::orc::TMOwningSimpleCompiler(std::move(*TM), cache));
+        });
+  auto jit = builder.create();
+  if (!jit)
+    error("cannot create JIT: " + llvm::toString(jit.takeError()));
+  llvm::orc::LLJIT &J = **jit;
+
+  // The runtime is linked into dtiger itself: give its primitives,
+  // and the garbage collector shadow stack, to the JIT as absolute
+  // symbols instead of searching the process.
+  const std::pair<const char *, llvm::JITTargetAddress> primitives[] = {
+      PRIMITIVE(__print_err), PRIMITIVE(__print),     PRIMITIVE(__print_int),
+      PRIMITIVE(__flush),     PRIMITIVE(__getchar),   PRIMITIVE(__ord),
+      PRIMITIVE(__chr),       PRIMITIVE(__size),      PRIMITIVE(__substring),
+      PRIMITIVE(__concat),    PRIMITIVE(__strcmp),    PRIMITIVE(__streq),
+      PRIMITIVE(__not),       PRIMITIVE(__exit),      PRIMITIVE(__gc_top),
+      PRIMITIVE(__chars)};
+
+  llvm::orc::MangleAndInterner mangle(J.getExecutionSession(),
+                                      J.getDataLayout());
+  llvm::orc::SymbolMap runtime;
+  for (auto &primitive : primitives)
+    runtime[mangle(primitive.first)] = llvm::JITEvaluatedSymbol(
+        primitive.second, llvm::JITSymbolFlags::Exported);
+  check(J.getMainJITDylib().define(llvm::orc::absoluteSymbols(runtime)),
+        "cannot define runtime symbols");
+  return std::move(*jit);
+}
+
+static int run_main(llvm::orc::LLJIT &J) {
+  auto main_symbol = J.lookup("main");
+  if (!main_symbol)
+    error("cannot find main: " + llvm::toString(main_symbol.takeError()));
+
+  // __exit leaves directly through exit(3), otherwise the
+  // status is the value returned by main.
+  auto *main = reinterpret_cast<int32_t (*)()>(main_symbol->getAddress());
+  return main();
+}
+
+int IRGenerator::run(llvm::ObjectCache *cache) {
+  std::unique_ptr<llvm::orc::LLJIT> J = create_jit(cache);
+  check(J->addIRModule(llvm::orc::ThreadSafeModule(std::move(Mod), TSContext)),
+        "cannot add module to JIT");
+  return run_main(*J);
+}
+
+int run_object(std::unique_ptr<llvm::MemoryBuffer> object) {
+  std::unique_ptr<llvm::orc::LLJIT> J = create_jit(nullptr);
+  check(J->addObjectFile(std::move(object)), "cannot add object to JIT");
+  return run_main(*J);
+}
+
+} // namespace irgen
@@ -0,0 +1,182 @@
+#include <unordered_map>
+
+#include "irgen.hh"
+
+namespace irgen {
+
+// Trivial runtime primitives are replaced by their code, and the
+// others by inlined fast paths falling back to the runtime. Strings
+// always hold a NUL byte after their characters, so that the first
+// byte of a string can be read even if it is empty.
+
+llvm::Value *IRGenerator::lower_primitive(
+    const FunDecl &decl, const std::vector<llvm::Value *> &args) {
+  typedef llvm::Value *(IRGenerator::*Lowering)(
+      const std::vector<llvm::Value *> &);
+  static const std::unordered_map<std::string, Lowering> lowerings = {
+      {"__not", &IRGenerator::lower_not},
+      {"__size", &IRGenerator::lower_size},
+      {"__ord", &IRGenerator::lower_ord},
+      {"__chr", &IRGenerator::lower_chr},
+      {"__streq", &IRGenerator::lower_streq},
+      {"__strcmp", &IRGenerator::lower_strcmp}};
+
+  auto lowering = lowerings.find(decl.get_external_name().get());
+  if (!decl.is_external || lowering == lowerings.end())
+    return nullptr;
+  return (this->*lowering->second)(args);
+}
+
+llvm::Value *IRGenerator::call_runtime(const std::string &name,
+                                       llvm::Type *result_type,
+                                       const std::vector<llvm::Value *> &args) {
+  std::vector<llvm::Type *> arg_types;
+  for (llvm::Value *arg : args)
+    arg_types.push_back(arg->getType());
+  auto function = Mod->getOrInsertFunction(
+      name, llvm::FunctionType::get(result_type, arg_types, false));
+  return Builder.CreateCall(function, args);
+}
+
+llvm::Value *IRGenerator::string_length(llvm::Value *s) {
+  return Builder.CreateLoad(Builder.CreateStructGEP(string_type, s, 0),
+                            "length");
+}
+
+llvm::Value *IRGenerator::first_char(llvm::Value *s) {
+  return Builder.CreateLoad(
+      Builder.CreateConstInBoundsGEP2_32(
+          string_type->getElementType(2),
+          Builder.CreateStructGEP(string_type, s, 2), 0, 0),
+      "first");
+}
+
+llvm::BasicBlock *IRGenerator::new_block(const std::string &name) {
+  return llvm::BasicBlock::Create(Context, name, current_function);
+}
+
+llvm::Value *IRGenerator::lower_not(const std::vector<llvm::Value *> &args) {
+  return Builder.CreateZExt(Builder.CreateIsNull(args[0]),
+                            Builder.getInt32Ty(), "not");
+}
+
+llvm::Value *IRGenerator::lower_size(const std::vector<llvm::Value *> &args) {
+  return string_length(args[0]);
+}
+
+llvm::Value *IRGenerator::lower_ord(const std::vector<llvm::Value *> &args) {
+  llvm::Value *const empty = Builder.CreateIsNull(string_length(args[0]));
+  return Builder.CreateSelect(
+      empty, Builder.getInt32(-1),
+      Builder.CreateZExt(first_char(args[0]), Builder.getInt32Ty()), "ord");
+}
+
+// Single-character strings come from the runtime table, once __chr
+// has filled their entry. Out of range characters and the first use
+// of a character go through __chr.
+llvm::Value *IRGenerator::lower_chr(const std::vector<llvm::Value *> &args) {
+  llvm::StructType *const char_type = llvm::StructType::get(
+      Context, {Builder.getInt32Ty(), Builder.getInt32Ty(),
+                llvm::ArrayType::get(Builder.getInt8Ty(), 2)});
+  llvm::ArrayType *const table_type = llvm::ArrayType::get(char_type, 256);
+  llvm::Constant *const table = Mod->getOrInsertGlobal("__chars", table_type);
+
+  llvm::BasicBlock *const table_block = new_block("chr_table");
+  llvm::BasicBlock *const slow_block = new_block("chr_slow");
+  llvm::BasicBlock *const end_block = new_block("chr_end");
+
+  Builder.CreateCondBr(Builder.CreateICmpULT(args[0], Builder.getInt32(256)),
+                       table_block, slow_block);
+  seal_block(table_block);
+
+  Builder.SetInsertPoint(table_block);
+  llvm::Value *const entry = Builder.CreateInBoundsGEP(
+      table_type, table, {Builder.getInt32(0), args[0]});
+  llvm::Value *const filled = Builder.CreateIsNotNull(
+      Builder.CreateLoad(Builder.CreateStructGEP(char_type, entry, 0)));
+  llvm::Value *const fast = Builder.CreateBitCast(entry, llvm_type(t_string));
+  Builder.CreateCondBr(filled, end_block, slow_block);
+  seal_block(slow_block);
+
+  Builder.SetInsertPoint(slow_block);
+  llvm::Value *const slow = call_runtime("__chr", llvm_type(t_string), args);
+  Builder.CreateBr(end_block);
+  seal_block(end_block);
+
+  Builder.SetInsertPoint(end_block);
+  llvm::PHINode *const result = Builder.CreatePHI(llvm_type(t_string), 2, "chr");
+  result->addIncoming(fast, table_block);
+  result->addIncoming(slow, slow_block);
+  return result;
+}
+
+// Identical strings are equal, strings whose lengths or first bytes
+// differ are not. Only the remaining cases compare the characters.
+llvm::Value *IRGenerator::lower_streq(const std::vector<llvm::Value *> &args) {
+  llvm::BasicBlock *const start_block = Builder.GetInsertBlock();
+  llvm::BasicBlock *const check_block = new_block("streq_check");
+  llvm::BasicBlock *const slow_block = new_block("streq_slow");
+  llvm::BasicBlock *const end_block = new_block("streq_end");
+
+  Builder.CreateCondBr(Builder.CreateICmpEQ(args[0], args[1]), end_block,
+                       check_block);
+  seal_block(check_block);
+
+  Builder.SetInsertPoint(check_block);
+  llvm::Value *const differ = Builder.CreateOr(
+      Builder.CreateICmpNE(string_length(args[0]), string_length(args[1])),
+      Builder.CreateICmpNE(first_char(args[0]), first_char(args[1])));
+  Builder.CreateCondBr(differ, end_block, slow_block);
+  seal_block(slow_block);
+
+  Builder.SetInsertPoint(slow_block);
+  llvm::Value *const slow = call_runtime("__streq", Builder.getInt32Ty(), args);
+  Builder.CreateBr(end_block);
+  seal_block(end_block);
+
+  Builder.SetInsertPoint(end_block);
+  llvm::PHINode *const result = Builder.CreatePHI(Builder.getInt32Ty(), 3, "streq");
+  result->addIncoming(Builder.getInt32(1), start_block);
+  result->addIncoming(Builder.getInt32(0), check_block);
+  result->addIncoming(slow, slow_block);
+  return result;
+}
+
+// Identical strings compare equal, and strings whose first bytes
+// differ are ordered by them: an empty string has a NUL first byte,
+// smaller than any other first byte.
+llvm::Value *IRGenerator::lower_strcmp(const std::vector<llvm::Value *> &args) {
+  llvm::BasicBlock *const start_block = Builder.GetInsertBlock();
+  llvm::BasicBlock *const check_block = new_block("strcmp_check");
+  llvm::BasicBlock *const slow_block = new_block("strcmp_slow");
+  llvm::BasicBlock *const end_block = new_block("strcmp_end");
+
+  Builder.CreateCondBr(Builder.CreateICmpEQ(args[0], args[1]), end_block,
+                       check_block);
+  seal_block(check_block);
+
+  Builder.SetInsertPoint(check_block);
+  llvm::Value *const first0 = first_char(args[0]);
+  llvm::Value *const first1 = first_char(args[1]);
+  llvm::Value *const order =
+      Builder.CreateSelect(Builder.CreateICmpULT(first0, first1),
+                           Builder.getInt32(-1), Builder.getInt32(1));
+  Builder.CreateCondBr(Builder.CreateICmpNE(first0, first1), end_block,
+                       slow_block);
+  seal_block(slow_block);
+
+  Builder.SetInsertPoint(slow_block);
+  llvm::Value *const slow = call_runtime("__strcmp", Builder.getInt32Ty(), args);
+  Builder.CreateBr(end_block);
+  seal_block(end_block);
+
+  Builder.SetInsertPoint(end_block);
+  llvm::PHINode *const result =
+      Builder.CreatePHI(Builder.getInt32Ty(), 3, "strcmp");
+  result->addIncoming(Builder.getInt32(0), start_block);
+  result->addIncoming(order, check_block);
+  result->addIncoming(slow, slow_block);
+  return result;
+}
+
+} // namespace irgen
@@ -0,0 +1,125 @@
+#include "irgen.hh"
+
+#include "llvm/IR/CFG.h"
+
+namespace irgen {
+
+// Variables kept in registers are turned into SSA values while the
+// code is generated, following Braun et al., "Simple and Efficient
+// Construction of Static Single Assignment Form" (CC 2013). Every
+// block records the last value written to each variable. Reading a
+// variable in a block which does not define it looks it up in the
+// predecessors, and creates a phi where several definitions join. A
+// block is sealed once all its predecessors are known and filled;
+// before that, its phis are left incomplete.
+
+// Variables captured from an ancestor are arguments of the current
+// function, which never assigns them. Variables of a function are one
+// level deeper than the function.
+bool IRGenerator::in_register(const VarDecl &decl) const {
+  return !decl.get_escapes() &&
+         (decl.get_type() == t_int ||
+          decl.get_depth() != current_function_decl->get_depth() + 1);
+}
+
+void IRGenerator::write_variable(const VarDecl &decl, llvm::BasicBlock *block,
+                                 llvm::Value *value) {
+  definitions[block][decl.get_id()] = value;
+}
+
+llvm::Value *IRGenerator::read_variable(const VarDecl &decl,
+                                        llvm::BasicBlock *block) {
+  std::unordered_map<int, llvm::WeakTrackingVH> &defs = definitions[block];
+  auto def = defs.find(decl.get_id());
+  if (def != defs.end())
+    return def->second;
+
+  llvm::Type *const type = llvm_type(decl.get_type());
+  llvm::Value *value;
+  if (!sealed_blocks.count(block)) {
+    llvm::PHINode *const phi = new_phi(type, block, decl.name.get());
+    incomplete_phis[block].emplace_back(&decl, phi);
+    value = phi;
+  } else if (llvm::BasicBlock *const pred = block->getSinglePredecessor()) {
+    value = read_variable(decl, pred);
+  } else if (llvm::pred_begin(block) == llvm::pred_end(block)) {
+    // Unreachable code, such as the code following a break.
+    value = llvm::UndefValue::get(type);
+  } else {
+    // The phi is the definition while its operands are read, which
+    // stops the recursion on loops.
+    llvm::PHINode *const phi = new_phi(type, block, decl.name.get());
+    write_variable(decl, block, phi);
+    value = add_phi_operands(decl, phi);
+  }
+  write_variable(decl, block, value);
+  return value;
+}
+
+llvm::PHINode *IRGenerator::new_phi(llvm::Type *type, llvm::BasicBlock *block,
+                                    const std::string &name) {
+  if (block->empty())
+    return llvm::PHINode::Create(type, 2, name, block);
+  return llvm::PHINode::Create(type, 2, name, &block->front());
+}
+
+llvm::Value *IRGenerator::add_phi_operands(const VarDecl &decl,
+                                           llvm::PHINode *phi) {
+  // There is one operand per edge, even if a block branches twice
+  // to the same successor.
+  llvm::BasicBlock *const block = phi->getParent();
+  const std::vector<llvm::BasicBlock *> preds(llvm::pred_begin(block),
+                                              llvm::pred_end(block));
+  for (llvm::BasicBlock *pred : preds)
+    phi->addIncoming(read_variable(decl, pred), pred);
+  return remove_trivial_phi(phi);
+}
+
+llvm::Value *IRGenerator::remove_trivial_phi(llvm::PHINode *phi) {
+  llvm::Value *same = nullptr;
+  for (llvm::Value *operand : phi->incoming_values()) {
+    if (operand == same || operand == phi)
+      continue;
+    if (same)
+      return phi;
+    same = operand;
+  }
+  if (!same)
+    same = llvm::UndefValue::get(phi->getType());
+
+  // Definitions and handles referring to the phi follow the
+  // replacement, so that phis using it may become trivial in turn.
+  std::vector<llvm::WeakTrackingVH> users;
+  for (llvm::User *user : phi->users())
+    if (user != phi && llvm::isa<llvm::PHINode>(user))
+      users.emplace_back(user);
+  llvm::WeakTrackingVH result(same);
+  phi->replaceAllUsesWith(same);
+  phi->eraseFromParent();
+  for (llvm::Value *user : users)
+    if (auto user_phi = llvm::dyn_cast_or_null<llvm::PHINode>(user))
+      remove_trivial_phi(user_phi);
+  return result;
+}
+
+void IRGenerator::seal_block(llvm::BasicBlock *block) {
+  for (auto &incomplete : incomplete_phis[block])
+    add_phi_operands(*incomplete.first, incomplete.second);
+  incomplete_phis.erase(block);
+  sealed_blocks.insert(block);
+}
+
+llvm::Value *IRGenerator::load_local(const VarDecl &decl) {
+  if (in_register(decl))
+    return read_variable(decl, Builder.GetInsertBlock());
+  return Builder.CreateLoad(entry(allocations, decl));
+}
+
+void IRGenerator::store_local(const VarDecl &decl, llvm::Value *value) {
+  if (in_register(decl))
+    write_variable(decl, Builder.GetInsertBlock(), value);
+  else
+    Builder.CreateStore(value, entry(allocations, decl));
+}
+
+} // namespace irgen
@@ -0,0 +1,121 @@
+#include "irgen.hh"
+
+namespace irgen {
+
+namespace {
+
+// Find the calls in tail position of a function body, whose value is
+// the one returned by the function: the last expression of sequences
+// and lets, and both parts of conditionals.
+class TailCallFinder : public ConstASTVisitor {
+  std::unordered_set<const FunCall *> &calls;
+  const ast::Type type;
+
+public:
+  TailCallFinder(std::unordered_set<const FunCall *> &_calls,
+                 ast::Type _type)
+      : calls(_calls), type(_type) {}
+
+  virtual void visit(const IntegerLiteral &) {}
+  virtual void visit(const StringLiteral &) {}
+  virtual void visit(const BinaryOperator &) {}
+  virtual void visit(const Sequence &seq) {
+    if (!seq.get_exprs().empty())
+      seq.get_exprs().back()->accept(*this);
+  }
+  virtual void visit(const Let &let) { let.get_sequence().accept(*this); }
+  virtual void visit(const Identifier &) {}
+  virtual void visit(const IfThenElse &ite) {
+    ite.get_then_part().accept(*this);
+    ite.get_else_part().accept(*this);
+  }
+  virtual void visit(const VarDecl &) {}
+  virtual void visit(const FunDecl &) {}
+  virtual void visit(const FunCall &call) {
+    // A procedure body may end with a call whose value is dropped.
+    if (call.get_type() == type && call.get_decl().get().get_expr())
+      calls.insert(&call);
+  }
+  virtual void visit(const WhileLoop &) {}
+  virtual void visit(const ForLoop &) {}
+  virtual void visit(const Break &) {}
+  virtual void visit(const Assign &) {}
+};
+
+} // namespace
+
+void IRGenerator::find_tail_calls() {
+  tail_calls.clear();
+  TailCallFinder finder(tail_calls, current_function_decl->get_type());
+  current_function_decl->get_expr()->accept(finder);
+
+  recursion_block = nullptr;
+  for (const FunCall *call : tail_calls)
+    if (&call->get_decl().get() == current_function_decl) {
+      recursion_block =
+          llvm::BasicBlock::Create(Context, "recurse", current_function);
+      break;
+    }
+}
+
+bool IRGenerator::is_tail_call(const FunCall &call) const {
+  if (!tail_calls.count(&call))
+    return false;
+  // A function nested in the current one gets its frame, which
+  // must outlive the call.
+  const FunDecl &decl = call.get_decl().get();
+  if (has_static_link(decl) && call.get_depth() == decl.get_depth())
+    return false;
+  // The frame of the current function is popped before the call, and
+  // its strings are only rooted there: the callee must not receive
+  // them as captured variables, which it keeps in registers.
+  for (const VarDecl *captured : captures(decl))
+    if (captured->get_type() == t_string &&
+        captured->get_depth() == current_function_decl->get_depth() + 1)
+      return false;
+  return true;
+}
+
+llvm::Value *IRGenerator::generate_tail_call(
+    const FunCall &call, llvm::Function *callee,
+    const std::vector<llvm::Value *> &args) {
+  const FunDecl &decl = call.get_decl().get();
+
+  if (&decl == current_function_decl) {
+    // The static link and the captured variables are unchanged. The
+    // arguments were all evaluated before any parameter is bound.
+    const std::vector<VarDecl *> &params = decl.get_params();
+    const size_t first = has_static_link(decl) ? 1 : 0;
+    for (size_t i = 0; i < params.size(); i++)
+      store_local(*params[i], args[first + i]);
+    Builder.CreateBr(recursion_block);
+  } else {
+    // The callee replaces the current function on the stack, which
+    // requires identical signatures and calling conventions. Other
+    // calls may still become sibling calls in the back end.
+    pop_gc_frame();
+    llvm::CallInst *const result = Builder.CreateCall(callee, args);
+    result->setCallingConv(callee->getCallingConv());
+    result->setTailCallKind(
+        callee->getFunctionType() == current_function->getFunctionType() &&
+                callee->getCallingConv() ==
+                    current_function->getCallingConv()
+            ? llvm::CallInst::TCK_MustTail
+            : llvm::CallInst::TCK_Tail);
+    if (decl.get_type() == t_void)
+      Builder.CreateRetVoid();
+    else
+      Builder.CreateRet(result);
+  }
+
+  // As after a break, the code following the call is unreachable.
+  llvm::BasicBlock *const dead_block =
+      llvm::BasicBlock::Create(Context, "after_tail_call", current_function);
+  Builder.SetInsertPoint(dead_block);
+  seal_block(dead_block);
+  if (decl.get_type() == t_void)
+    return nullptr;
+  return llvm::UndefValue::get(llvm_type(decl.get_type()));
+}
+
+} // namespace irgen
@@ -12,13 +12,33 @@ llvm::Value *IRGenerator::visit(const IntegerLiteral &literal) {
 }
 
 llvm::Value *IRGenerator::visit(const StringLiteral &literal) {
-  return Builder.CreateGlobalStringPtr(literal.value.get());
+  // Emit a constant string object, with the same layout as the
+  // string type but an array sized for the literal.
+  const std::string &value = literal.value.get();
+  llvm::Constant *chars = llvm::ConstantDataArray::getString(Context, value);
+  // Its zero garbage collector field marks it as static.
+  llvm::StructType *type = llvm::StructType::get(
+      Context, {Builder.getInt32Ty(), Builder.getInt32Ty(), chars->getType()});
+  llvm::GlobalVariable *global = new llvm::GlobalVariable(
+      *Mod, type, true, llvm::GlobalValue::PrivateLinkage,
+      llvm::ConstantStruct::get(
+          type, {Builder.getInt32(value.size()), Builder.getInt32(0), chars}),
+      "str");
+  global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+  return llvm::ConstantExpr::getBitCast(global, llvm_type(t_string));
 }
 
 llvm::Value *IRGenerator::visit(const Break &b) {
   if(b.get_loop()){
-    llvm::BasicBlock* end_block = loop_exit_bbs[&b.get_loop().value()];
-    Builder.CreateBr(end_block);
+    // A break always leaves the innermost loop.
+    Builder.CreateBr(loop_exits.back());
+
+    // The code following the break, if any, is unreachable. It goes
+    // into a block without predecessors.
+    llvm::BasicBlock *const dead_block =
+        llvm::BasicBlock::Create(Context, "after_break", current_function);
+    Builder.SetInsertPoint(dead_block);
+    seal_block(dead_block);
   }
   return nullptr;
 }
@@ -31,17 +51,19 @@ llvm::Value *IRGenerator::visit(const BinaryOperator &op) {
   }
 
   llvm::Value *l = op.get_left().accept(*this);
+  keep_alive(op.get_left(), l);
   llvm::Value *r = op.get_right().accept(*this);
 
+  // Strings are compared through the equality or the ordering
+  // primitive, whose result is then compared.
   if (op.get_left().get_type() == t_string) {
-    auto const strcmp = Mod->getOrInsertFunction("__strcmp", Builder.getInt32Ty(),
-        Builder.getInt8PtrTy(), Builder.getInt8PtrTy()
-#if LLVM_VERSION_MAJOR < 5
-        , nullptr  // Older versions of LLVM uses C-vararg with a NULL end sigil
-#endif // LLVM_MAJOR_VERSION < 5
-        );
-    l = Builder.CreateCall(strcmp, {l, r});
-    r = Builder.getInt32(0);
+    if (op.op == o_eq || op.op == o_neq) {
+      l = lower_streq({l, r});
+      r = Builder.getInt32(1);
+    } else {
+      l = lower_strcmp({l, r});
+      r = Builder.getInt32(0);
+    }
   }
 
   switch(op.op) {
@@ -89,68 +111,45 @@ llvm::Value *IRGenerator::visit(const Identifier &id) {
   if (id.get_type() == t_void){
     return nullptr;
   }
-  return Builder.CreateLoad(address_of(id));
+  return load_variable(id.get_decl().get(), id.get_depth());
 }
 
-llvm::Value *IRGenerator::visit(const IfThenElse &ite)
-{
-  llvm::Value * result = nullptr;
-
-  // creation de result
-  if (ite.get_type() != t_void)
-  {
-    result = alloca_in_entry(llvm_type(ite.get_type()), "if_result");
-  }
-
-
-  llvm::BasicBlock *then_block = llvm::BasicBlock::Create(Context, "if_then", current_function);
-  llvm::BasicBlock *else_block = llvm::BasicBlock::Create(Context, "if_else", current_function);
-  llvm::BasicBlock *end_block = llvm::BasicBlock::Create(Context, "if_end", current_function);
+llvm::Value *IRGenerator::visit(const IfThenElse &ite) {
+  llvm::BasicBlock *const then_block =
+      llvm::BasicBlock::Create(Context, "if_then", current_function);
+  llvm::BasicBlock *const else_block =
+      llvm::BasicBlock::Create(Context, "if_else", current_function);
+  llvm::BasicBlock *const end_block =
+      llvm::BasicBlock::Create(Context, "if_end", current_function);
 
   // Branch depending on the condition
   Builder.CreateCondBr(
       Builder.CreateIsNotNull(ite.get_condition().accept(*this)),
-      then_block,
-      else_block);
-      
+      then_block, else_block);
+  seal_block(then_block);
+  seal_block(else_block);
 
-  // then part
+  // Each part may end in another block than the one it started in.
   Builder.SetInsertPoint(then_block);
-  if (result)
-  {
-    llvm::Value *const then_result = ite.get_then_part().accept(*this);
-    Builder.CreateStore(then_result, result);
-  }
-  else
-  {
-    ite.get_then_part().accept(*this);
-  }
+  llvm::Value *const then_result = ite.get_then_part().accept(*this);
+  llvm::BasicBlock *const then_end = Builder.GetInsertBlock();
   Builder.CreateBr(end_block);
-  
 
-  // else part
   Builder.SetInsertPoint(else_block);
-  if (result)
-  {
-    llvm::Value *const else_result = ite.get_else_part().accept(*this);
-    Builder.CreateStore(else_result, result);
-  }
-  else
-  {
-    ite.get_else_part().accept(*this);
-  }
+  llvm::Value *const else_result = ite.get_else_part().accept(*this);
+  llvm::BasicBlock *const else_end = Builder.GetInsertBlock();
   Builder.CreateBr(end_block);
 
-  // end part
   Builder.SetInsertPoint(end_block);
-  if (result)
-  {
-    return Builder.CreateLoad(result);
-  }
-  else
-  {
+  seal_block(end_block);
+  if (ite.get_type() == t_void)
     return nullptr;
-  }
+
+  llvm::PHINode *const result =
+      Builder.CreatePHI(llvm_type(ite.get_type()), 2, "if_result");
+  result->addIncoming(then_result, then_end);
+  result->addIncoming(else_result, else_end);
+  return result;
 }
 
 llvm::Value *IRGenerator::visit(const VarDecl &decl)
@@ -162,37 +161,41 @@ llvm::Value *IRGenerator::visit(const VarDecl &decl)
     return nullptr;
   }
 
-  llvm::Value *alloc = generate_vardecl(decl);
-  if (decl.get_expr())
-  {
-    llvm::Value *expr = decl.get_expr().value().accept(*this);
-    Builder.CreateStore(expr, alloc);
-  }
-  allocations[&decl] = alloc;
-  return alloc;
+  declare_local(decl, decl.get_expr()->accept(*this));
+  return nullptr;
 }
 
 llvm::Value *IRGenerator::visit(const FunDecl &decl) {
   std::vector<llvm::Type *> param_types;
 
-  if (!decl.is_external && decl.get_parent()) {
+  if (has_static_link(decl)) {
     const FunDecl &parent = decl.get_parent().value();
-    param_types.push_back(frame_type[&parent]->getPointerTo());
+    param_types.push_back(entry(frame_type, parent)->getPointerTo());
   }
 
   for (auto param_decl : decl.get_params()) {
     param_types.push_back(llvm_type(param_decl->get_type()));
   }
 
+  // Captured variables follow the parameters.
+  for (auto captured : captures(decl)) {
+    param_types.push_back(llvm_type(captured->get_type()));
+  }
+
   llvm::Type *return_type = llvm_type(decl.get_type());
 
   llvm::FunctionType *ft =
       llvm::FunctionType::get(return_type, param_types, false);
 
-  llvm::Function::Create(ft,
-                         decl.is_external ? llvm::Function::ExternalLinkage
-                                          : llvm::Function::InternalLinkage,
-                         decl.get_external_name().get(), Mod.get());
+  llvm::Function *const function = llvm::Function::Create(
+      ft,
+      decl.is_external ? llvm::Function::ExternalLinkage
+                       : llvm::Function::InternalLinkage,
+      decl.get_external_name().get(), Mod.get());
+  // Internal functions are only called from the generated code, which
+  // lets them use the calling convention supporting tail calls.
+  if (!decl.is_external)
+    function->setCallingConv(llvm::CallingConv::Fast);
 
   if (decl.get_expr())
     pending_func_bodies.push_front(&decl);
@@ -201,8 +204,29 @@ llvm::Value *IRGenerator::visit(const FunDecl &decl) {
 }
 
 llvm::Value *IRGenerator::visit(const FunCall &call) {
-  // Look up the name in the global module table.
   const FunDecl &decl = call.get_decl().get();
+  std::vector<llvm::Value *> args_values;
+
+  if (has_static_link(decl)) {
+    std::pair<llvm::StructType *, llvm::Value *> fu = frame_up(call.get_depth()-decl.get_depth());
+    args_values.push_back(fu.second);
+  }
+
+  for (auto expr : call.get_args()) {
+    args_values.push_back(expr->accept(*this));
+    keep_alive(*expr, args_values.back());
+  }
+
+  // Reading the captured variables does not allocate, the last
+  // argument needs no root.
+  for (auto captured : captures(decl)) {
+    args_values.push_back(load_variable(*captured, call.get_depth()));
+  }
+
+  if (llvm::Value *const lowered = lower_primitive(decl, args_values))
+    return lowered;
+
+  // Look up the name in the global module table.
   llvm::Function *callee =
       Mod->getFunction(decl.get_external_name().get());
 
@@ -214,22 +238,16 @@ llvm::Value *IRGenerator::visit(const FunCall &call) {
     callee = Mod->getFunction(decl.get_external_name().get());
   }
 
-  std::vector<llvm::Value *> args_values;
-
-  if (!decl.is_external) {
-    std::pair<llvm::StructType *, llvm::Value *> fu = frame_up(call.get_depth()-decl.get_depth());
-    args_values.push_back(fu.second);
-  }
-
-  for (auto expr : call.get_args()) {
-    args_values.push_back(expr->accept(*this));
-  }
+  if (is_tail_call(call))
+    return generate_tail_call(call, callee, args_values);
 
-  if (decl.get_type() == t_void) {
-    Builder.CreateCall(callee, args_values);
-    return nullptr;
-  }
-  return Builder.CreateCall(callee, args_values, "call");
+  llvm::CallInst *result;
+  if (decl.get_type() == t_void)
+    result = Builder.CreateCall(callee, args_values);
+  else
+    result = Builder.CreateCall(callee, args_values, "call");
+  result->setCallingConv(callee->getCallingConv());
+  return decl.get_type() == t_void ? nullptr : result;
 }
 
 llvm::Value *IRGenerator::visit(const WhileLoop &loop) {
@@ -240,7 +258,7 @@ llvm::Value *IRGenerator::visit(const WhileLoop &loop) {
   llvm::BasicBlock *const end_block =
       llvm::BasicBlock::Create(Context, "loop_end", current_function);
 
-  loop_exit_bbs[&loop] = end_block;
+  loop_exits.push_back(end_block);
 
   Builder.CreateBr(test_block);
   Builder.SetInsertPoint(test_block);
@@ -248,11 +266,16 @@ llvm::Value *IRGenerator::visit(const WhileLoop &loop) {
       Builder.CreateIsNotNull(loop.get_condition().accept(*this)),
       body_block,
       end_block);
+  seal_block(body_block);
 
   Builder.SetInsertPoint(body_block);
   loop.get_body().accept(*this);
   Builder.CreateBr(test_block);
+  loop_exits.pop_back();
 
+  // The back edge and the breaks are known once the body is done.
+  seal_block(test_block);
+  seal_block(end_block);
 
   Builder.SetInsertPoint(end_block);
   return nullptr;
@@ -265,22 +288,28 @@ llvm::Value *IRGenerator::visit(const ForLoop &loop) {
       llvm::BasicBlock::Create(Context, "loop_body", current_function);
   llvm::BasicBlock *const end_block =
       llvm::BasicBlock::Create(Context, "loop_end", current_function);
-  llvm::Value *const index = loop.get_variable().accept(*this);
+  const VarDecl &index = loop.get_variable();
+  index.accept(*this);
   llvm::Value *const high = loop.get_high().accept(*this);
 
-  loop_exit_bbs[&loop] = end_block;
+  loop_exits.push_back(end_block);
 
   Builder.CreateBr(test_block);
 
   Builder.SetInsertPoint(test_block);
-  Builder.CreateCondBr(Builder.CreateICmpSLE(Builder.CreateLoad(index), high),
+  Builder.CreateCondBr(Builder.CreateICmpSLE(load_local(index), high),
                        body_block, end_block);
+  seal_block(body_block);
 
   Builder.SetInsertPoint(body_block);
   loop.get_body().accept(*this);
-  Builder.CreateStore(
-      Builder.CreateAdd(Builder.CreateLoad(index), Builder.getInt32(1)), index);
+  store_local(index,
+              Builder.CreateAdd(load_local(index), Builder.getInt32(1)));
   Builder.CreateBr(test_block);
+  loop_exits.pop_back();
+
+  seal_block(test_block);
+  seal_block(end_block);
 
   Builder.SetInsertPoint(end_block);
   return nullptr;
@@ -292,7 +321,12 @@ llvm::Value *IRGenerator::visit(const Assign &assign)
   if (assign.get_lhs().get_type() == t_void)
     return nullptr;
   const Identifier &id = assign.get_lhs();
-  return Builder.CreateStore(expr, address_of(id));
+  if (in_register(id.get_decl().get())) {
+    store_local(id.get_decl().get(), expr);
+    return nullptr;
+  }
+  return Builder.CreateStore(expr,
+                             address_of(id.get_decl().get(), id.get_depth()));
 }
 
 } // namespace irgen
\ No newline at end of file
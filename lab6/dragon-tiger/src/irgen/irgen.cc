@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "irgen.hh"
 #include "../utils/errors.hh"
 
@@ -8,8 +10,22 @@ using utils::error;
 
 namespace irgen {
 
-IRGenerator::IRGenerator() : Builder(Context) {
+IRGenerator::IRGenerator(const opt::LambdaLifter *_closures)
+    : TSContext(llvm::make_unique<llvm::LLVMContext>()),
+      Context(*TSContext.getContext()), Builder(Context),
+      closures(_closures) {
   Mod = llvm::make_unique<llvm::Module>("tiger", Context);
+  string_type = llvm::StructType::create(
+      Context,
+      {Builder.getInt32Ty(), Builder.getInt32Ty(),
+       llvm::ArrayType::get(Builder.getInt8Ty(), 0)},
+      "string");
+  gc_frame_type = llvm::StructType::create(Context, "gc_frame");
+  gc_frame_type->setBody(
+      {gc_frame_type->getPointerTo(), Builder.getInt8PtrTy()});
+  gc_top = new llvm::GlobalVariable(
+      *Mod, gc_frame_type->getPointerTo(), false,
+      llvm::GlobalValue::ExternalLinkage, nullptr, "__gc_top");
 }
 
 llvm::Type *IRGenerator::llvm_type(const ast::Type ast_type) {
@@ -17,7 +33,7 @@ llvm::Type *IRGenerator::llvm_type(const ast::Type ast_type) {
   case t_int:
     return Builder.getInt32Ty();
   case t_string:
-    return Builder.getInt8PtrTy();
+    return string_type->getPointerTo();
   case t_void:
     return Builder.getVoidTy();
   default:
@@ -25,13 +41,13 @@ llvm::Type *IRGenerator::llvm_type(const ast::Type ast_type) {
   }
 }
 
-llvm::Value *IRGenerator::alloca_in_entry(llvm::Type *Ty,
-                                          const std::string &name) {
-  llvm::IRBuilderBase::InsertPoint const saved = Builder.saveIP();
-  Builder.SetInsertPoint(&current_function->getEntryBlock());
-  llvm::Value *const value = Builder.CreateAlloca(Ty, nullptr, name);
-  Builder.restoreIP(saved);
-  return value;
+size_t IRGenerator::instruction_count() const {
+  if (!Mod)
+    return 0;
+  size_t count = 0;
+  for (const llvm::Function &F : *Mod)
+    count += F.getInstructionCount();
+  return count;
 }
 
 void IRGenerator::print_ir(std::ostream *ostream) {
@@ -44,26 +60,43 @@ void IRGenerator::print_ir(std::ostream *ostream) {
   *ostream << buffer;
 }
 
-llvm::Value *IRGenerator::address_of(const Identifier &id)
+bool IRGenerator::has_static_link(const FunDecl &decl) const
+{
+  if (decl.is_external || !decl.get_parent())
+    return false;
+  return !closures || closures->has_static_link(decl);
+}
+
+const std::vector<VarDecl *> &IRGenerator::captures(const FunDecl &decl) const
+{
+  static const std::vector<VarDecl *> none;
+  return closures && decl.get_expr() ? closures->get_captures(decl) : none;
+}
+
+llvm::Value *IRGenerator::address_of(const VarDecl &decl, int depth)
 {
-  assert(id.get_decl());
-  const VarDecl &decl = dynamic_cast<const VarDecl &>(id.get_decl().get());
   // variable used at the same depth
   if (!decl.get_escapes())
   {
-    return allocations[&decl];
+    return entry(allocations, decl);
   }
   else
   {
     // use of frame_up to find the address of the function
-    std::pair<llvm::StructType *, llvm::Value *> fu = frame_up(id.get_depth() - decl.get_depth());
+    std::pair<llvm::StructType *, llvm::Value *> fu = frame_up(depth - decl.get_depth());
     llvm::StructType * ft = fu.first;
     llvm::Value * sl = fu.second;
-    int pos = frame_position[&decl];
+    int pos = entry(frame_position, decl);
 
     return Builder.CreateStructGEP(ft, sl, pos);
   }
-  return allocations[&decl];
+}
+
+llvm::Value *IRGenerator::load_variable(const VarDecl &decl, int depth)
+{
+  if (in_register(decl))
+    return load_local(decl);
+  return Builder.CreateLoad(address_of(decl, depth));
 }
 
 void IRGenerator::generate_program(FunDecl *main) {
@@ -77,9 +110,11 @@ void IRGenerator::generate_program(FunDecl *main) {
 
 void IRGenerator::generate_function(const FunDecl &decl)
 {
-  // Reinitialize common structures.
-  allocations.clear();
-  loop_exit_bbs.clear();
+  // Reinitialize common structures. Per-declaration tables are kept,
+  // as declarations belong to a single function.
+  definitions.clear();
+  incomplete_phis.clear();
+  sealed_blocks.clear();
 
   // Set current function
   current_function = Mod->getFunction(decl.get_external_name().get());
@@ -92,49 +127,63 @@ void IRGenerator::generate_function(const FunDecl &decl)
 
   Builder.SetInsertPoint(bb1);
   generate_frame();
+  entry_block = bb1;
+  display.assign(1, std::make_pair(&decl, frame));
 
   // Create a second basic block for body insertion
   llvm::BasicBlock *bb2 =
       llvm::BasicBlock::Create(Context, "body", current_function);
 
   Builder.SetInsertPoint(bb2);
+  // The branch from the entry is added last, no definition comes
+  // from there.
+  seal_block(bb2);
+  find_tail_calls();
+
+  // Set the name for each argument and define the parameter with it.
+  auto arg = current_function->arg_begin();
+  if (has_static_link(decl))
+  {
+    arg->setName("top");
+    Builder.CreateStore(&*arg, Builder.CreateStructGEP(entry(frame_type, decl), frame, frame_link_field));
+    // The parent frame is the static link itself.
+    display.push_back(std::make_pair(&decl.get_parent().value(), &*arg));
+    ++arg;
+  }
+  for (VarDecl *param : params)
+  {
+    arg->setName(param->name.get());
+    declare_local(*param, &*arg);
+    ++arg;
+  }
+  // Captured variables are never assigned here, their value holds in
+  // the whole body.
+  for (VarDecl *captured : captures(decl))
+  {
+    arg->setName(captured->name.get());
+    write_variable(*captured, bb2, &*arg);
+    ++arg;
+  }
 
-  // Set the name for each argument and register it in the allocations map
-  // after storing it in an alloca.
-  unsigned i = 0;
-  for (auto &arg : current_function->args())
+  // The body starts again from the recursion block after the
+  // parameters are bound, its loop back edges are known at the end.
+  if (recursion_block)
   {
-    // analyzing a non external function
-    if (!decl.is_external)
-    {
-      if (i == 0)
-      {
-        arg.setName("top");
-        Builder.CreateStore(&arg, Builder.CreateStructGEP(frame_type[&decl], frame, 0));
-      }
-      else
-      {
-        arg.setName(params[i - 1]->name.get());
-        Builder.CreateStore(&arg, generate_vardecl(*params[i - 1]));
-      }
-    }
-    // external function
-    else
-    {
-      arg.setName(params[i]->name.get());
-      Builder.CreateStore(&arg, generate_vardecl(*params[i]));
-    }
-    i++;
+    Builder.CreateBr(recursion_block);
+    Builder.SetInsertPoint(recursion_block);
   }
 
   // Visit the body
   llvm::Value *expr = decl.get_expr()->accept(*this);
 
   // Finish off the function.
+  pop_gc_frame();
   if (decl.get_type() == t_void)
     Builder.CreateRetVoid();
   else
     Builder.CreateRet(expr);
+  if (recursion_block)
+    seal_block(recursion_block);
 
   // Jump from entry to body
   Builder.SetInsertPoint(bb1);
@@ -149,18 +198,65 @@ void IRGenerator::generate_frame()
   // Vector of types needed in frame
   std::vector<llvm::Type *> framed_var;
 
-  // first field is a pointer to parent frame
-  if (current_function_decl->get_parent())
+  // first field links the frame in the shadow stack
+  framed_var.push_back(gc_frame_type);
+
+  // second field is a pointer to parent frame
+  if (has_static_link(*current_function_decl))
   {
-    framed_var.push_back(frame_type[&current_function_decl->get_parent().value()]->getPointerTo());
+    framed_var.push_back(entry(frame_type, current_function_decl->get_parent().value())->getPointerTo());
   }
 
-  // types of escaping declarations
-  for (VarDecl *escaping_decl : current_function_decl->get_escaping_decls())
+  // Other slots hold the escaping variables, the strings which do not
+  // escape (still kept in the frame, where the garbage collector can
+  // find them) and the string temporaries. Each is given its position
+  // once, by decreasing alignment so that the frame is packed tightly.
+  std::vector<std::pair<const VarDecl *, const Expr *>> slots;
+  for (const VarDecl *escaping_decl :
+       current_function_decl->get_escaping_decls())
   {
     if (escaping_decl->get_type() != t_void)
     {
-      framed_var.push_back(llvm_type(escaping_decl->get_type()));
+      slots.emplace_back(escaping_decl, nullptr);
+    }
+  }
+  std::vector<const VarDecl *> rooted_vars;
+  std::vector<const Expr *> temporaries;
+  collect_roots(rooted_vars, temporaries);
+  for (const VarDecl *var : rooted_vars)
+  {
+    slots.emplace_back(var, nullptr);
+  }
+  for (const Expr *temporary : temporaries)
+  {
+    slots.emplace_back(nullptr, temporary);
+  }
+
+  auto slot_type = [this](const std::pair<const VarDecl *, const Expr *> &slot) {
+    return llvm_type(slot.first ? slot.first->get_type() : t_string);
+  };
+  const llvm::DataLayout &layout = Mod->getDataLayout();
+  std::stable_sort(slots.begin(), slots.end(),
+                   [&](const std::pair<const VarDecl *, const Expr *> &a,
+                       const std::pair<const VarDecl *, const Expr *> &b) {
+                     return layout.getABITypeAlignment(slot_type(a)) >
+                            layout.getABITypeAlignment(slot_type(b));
+                   });
+  for (const auto &slot : slots)
+  {
+    if (slot.first)
+      entry(frame_position, *slot.first) = framed_var.size();
+    else
+      root_position[slot.second] = framed_var.size();
+    framed_var.push_back(slot_type(slot));
+  }
+
+  std::vector<unsigned> roots;
+  for (unsigned i = 0; i < framed_var.size(); i++)
+  {
+    if (framed_var[i] == llvm_type(t_string))
+    {
+      roots.push_back(i);
     }
   }
 
@@ -171,61 +267,54 @@ void IRGenerator::generate_frame()
   llvm::StructType *ft_ = llvm::StructType::create(Context, framed_var, "ft_" + ext_name);
 
   // register
-  frame_type[current_function_decl] = ft_;
+  entry(frame_type, *current_function_decl) = ft_;
 
   // allocate new object on the stack
   frame = Builder.CreateAlloca(ft_, nullptr, "frame_" + ext_name);
+  push_gc_frame(roots);
 }
 
 std::pair<llvm::StructType *, llvm::Value *> IRGenerator::frame_up(int levels)
 {
-
-  const FunDecl *fun = current_function_decl;
-  llvm::Value *sl = frame;
-
-  for (int i = 0; i < levels; i++)
+  if (size_t(levels) >= display.size())
   {
-    sl = Builder.CreateLoad(Builder.CreateStructGEP(frame_type[fun], sl, 0));
-    if (fun->get_parent())
+    // The entry block dominates every use of the loaded frames.
+    llvm::IRBuilderBase::InsertPointGuard guard(Builder);
+    Builder.SetInsertPoint(entry_block);
+    while (display.size() <= size_t(levels))
     {
-      fun = &fun->get_parent().value();
-    }
-    else
-    {
-      utils::error("Error: Cannot go further up in frame.");
+      const FunDecl *fun = display.back().first;
+      if (!has_static_link(*fun))
+      {
+        utils::error("Error: Cannot go further up in frame.");
+      }
+      llvm::Value *sl = Builder.CreateLoad(Builder.CreateStructGEP(
+          entry(frame_type, *fun), display.back().second, frame_link_field));
+      display.push_back(std::make_pair(&fun->get_parent().value(), sl));
     }
   }
 
-  return std::make_pair(frame_type[fun], sl);
+  return std::make_pair(entry(frame_type, *display[levels].first),
+                        display[levels].second);
 }
 
-llvm::Value *IRGenerator::generate_vardecl(const VarDecl &decl)
+void IRGenerator::declare_local(const VarDecl &decl, llvm::Value *value)
 {
-  llvm::Value * alloc = nullptr;
-
-  // if it does not escape
-  if (!decl.get_escapes())
-  {
-    alloc = alloca_in_entry(llvm_type(decl.get_type()), std::string(decl.name));
-  }
+  if (in_register(decl))
+    write_variable(decl, Builder.GetInsertBlock(), value);
   else
-  {
-    std::vector<VarDecl *> decls = current_function_decl->get_escaping_decls();
-
-    // find the position in the sequence of escaping variables
-    auto it = std::find(decls.begin(), decls.end(), &decl);
-    if (it == decls.end()){
-      utils::error(decl.loc, "Decl escape not in a escape decl.");
-    }
-    int pos = std::distance(decls.begin(), it);
-    if (current_function_decl->get_parent()){
-      pos = pos + 1;
-    }
-    frame_position[&decl] = pos;
+    Builder.CreateStore(value, generate_vardecl(decl));
+}
 
-    alloc = Builder.CreateStructGEP(frame_type[current_function_decl], frame, pos);
-  }
-  allocations[&decl]=alloc;
+llvm::Value *IRGenerator::generate_vardecl(const VarDecl &decl)
+{
+  // Escaping variables, and strings which do not escape, got their
+  // position when the frame was built.
+  assert(decl.get_escapes() || decl.get_type() == t_string);
+  llvm::Value *const alloc =
+      Builder.CreateStructGEP(entry(frame_type, *current_function_decl), frame,
+                              entry(frame_position, decl));
+  entry(allocations, decl) = alloc;
   return alloc;
 }
 
@@ -2,21 +2,32 @@
 #define IRGEN_HH
 
 #include <deque>
+#include <map>
 #include <ostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "../ast/nodes.hh"
+#include "../opt/lambda_lifter.hh"
 
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/ValueHandle.h"
+#include "llvm/Target/TargetMachine.h"
 
 namespace irgen {
 using namespace ast::types;
 
 class IRGenerator : public ConstASTValueVisitor {
   // Hold the core "global" data of LLVM's core infrastructure,
-  // including the type and constant uniquing tables.
-  llvm::LLVMContext Context;
+  // including the type and constant uniquing tables. The context
+  // is shared with the JIT when the program is run in-process.
+  llvm::orc::ThreadSafeContext TSContext;
+  llvm::LLVMContext &Context;
 
   // Builder to insert instructions into a basic block.
   llvm::IRBuilder<> Builder;
@@ -24,19 +35,58 @@ class IRGenerator : public ConstASTValueVisitor {
   // Module generated by this tiger program compilation.
   std::unique_ptr<llvm::Module> Mod;
 
+  // Runtime representation of strings: a length and a garbage
+  // collector field followed by the NUL-terminated characters,
+  // { i32, i32, [0 x i8] }.
+  llvm::StructType *string_type;
+
+  // Shadow stack record linking the frames holding strings for the
+  // garbage collector, { gc_frame *, i8 * }, and the stack top.
+  llvm::StructType *gc_frame_type;
+  llvm::GlobalVariable *gc_top;
+
+  // How nested functions reach the variables of their ancestors, or
+  // nullptr if every nested function uses its static link.
+  const opt::LambdaLifter *closures;
+  bool has_static_link(const FunDecl &decl) const;
+  const std::vector<VarDecl *> &captures(const FunDecl &decl) const;
+
   // Current function being generated.
   llvm::Function *current_function;
   const FunDecl *current_function_decl;
 
-  // Map variable declarations (including function parameters)
-  // to LLVM values. Those values might refer to the current
-  // function frame if they are escaping, or to
-  // alloca-declared variables if they are not escaping.
-  std::map<const VarDecl *, llvm::Value *> allocations;
+  // Per-declaration data is kept in flat tables indexed by the
+  // dense identifier opt::Numberer gives to every declaration.
+  template <typename T>
+  static T &entry(std::vector<T> &table, const Decl &decl) {
+    assert(decl.get_id() >= 0);
+    if (size_t(decl.get_id()) >= table.size())
+      table.resize(decl.get_id() + 1);
+    return table[decl.get_id()];
+  }
+
+  // Address in their function frame of the variable declarations
+  // (including function parameters) kept in memory. Those are the
+  // escaping variables and the strings, which the garbage collector
+  // must see.
+  std::vector<llvm::Value *> allocations;
 
-  // Map loops to their exit blocks, so that early exits can
-  // be easily processed.
-  std::map<const Loop *, llvm::BasicBlock *> loop_exit_bbs;
+  // Other variables live in registers, as SSA values built while
+  // the code is generated (see irgen-ssa.cc): the last definition
+  // of each variable in each block, the phis waiting for the
+  // predecessors of their block, and the blocks whose predecessors
+  // are all known.
+  std::unordered_map<llvm::BasicBlock *,
+                     std::unordered_map<int, llvm::WeakTrackingVH>>
+      definitions;
+  std::unordered_map<llvm::BasicBlock *,
+                     std::vector<std::pair<const VarDecl *, llvm::PHINode *>>>
+      incomplete_phis;
+  std::unordered_set<llvm::BasicBlock *> sealed_blocks;
+
+  // Exit blocks of the loops being generated, innermost last, so
+  // that early exits can be easily processed.
+  std::vector<llvm::BasicBlock *> loop_exits;
 
   // List of functions to be processed after the current one.
   // This is necessary because in Tiger we might encounter
@@ -46,21 +96,108 @@ class IRGenerator : public ConstASTValueVisitor {
   // generation before handling the next one.
   std::deque<const FunDecl *> pending_func_bodies;
 
-  // Map escaping variables to their position into the current
-  // function frame.
-  std::map<const VarDecl *, int> frame_position;
+  // Position of escaping variables, and non-escaping string
+  // variables, into the frame of their function.
+  std::vector<int> frame_position;
+
+  // Map string temporaries which must be kept alive while other
+  // expressions are evaluated to their position into the frame.
+  std::map<const Expr *, int> root_position;
 
-  // Map function declarations to their specific frame types.
-  std::map<const FunDecl *, llvm::StructType *> frame_type;
+  // Frame type of every function declaration.
+  std::vector<llvm::StructType *> frame_type;
 
   // Frame of the current function.
   llvm::Value *frame;
 
+  // Display of the current function: the frames of the function and
+  // of its ancestors, with their declarations, indexed by nesting
+  // distance. Static links never change, so each ancestor frame is
+  // loaded once, in the entry block, when it is first needed.
+  llvm::BasicBlock *entry_block;
+  std::vector<std::pair<const FunDecl *, llvm::Value *>> display;
+
+  // Every frame starts with its shadow stack record, followed by
+  // the static link if the function has a parent.
+  enum { frame_gc_field = 0, frame_link_field = 1 };
+
+  // Shadow stack record of the current frame, or nullptr if the
+  // frame holds no string.
+  llvm::Value *gc_record;
+
+  // Calls in tail position in the current function (see
+  // irgen-tail.cc). Self-recursive ones bind the parameters again
+  // and jump to the recursion block, others end the function.
+  std::unordered_set<const FunCall *> tail_calls;
+  llvm::BasicBlock *recursion_block;
+  void find_tail_calls();
+  bool is_tail_call(const FunCall &call) const;
+  llvm::Value *generate_tail_call(const FunCall &call, llvm::Function *callee,
+                                  const std::vector<llvm::Value *> &args);
+
   // Generate the frame of the current function
   void generate_frame();
 
+  // Find the non-escaping string variables of the current function
+  // and the string temporaries which must be rooted in its frame.
+  void collect_roots(std::vector<const VarDecl *> &vars,
+                     std::vector<const Expr *> &temporaries);
+
+  // Clear the given string fields of the current frame, and link
+  // it to the shadow stack if there is any.
+  void push_gc_frame(const std::vector<unsigned> &roots);
+
+  // Unlink the current frame from the shadow stack, before returning.
+  void pop_gc_frame();
+
+  // Store the value of expr in its frame root, if it has one.
+  void keep_alive(const Expr &expr, llvm::Value *value);
+
+  // Generate the code of a runtime primitive in place of its call,
+  // or return nullptr if it is always called (see
+  // irgen-primitives.cc).
+  llvm::Value *lower_primitive(const FunDecl &decl,
+                               const std::vector<llvm::Value *> &args);
+  llvm::Value *lower_not(const std::vector<llvm::Value *> &args);
+  llvm::Value *lower_size(const std::vector<llvm::Value *> &args);
+  llvm::Value *lower_ord(const std::vector<llvm::Value *> &args);
+  llvm::Value *lower_chr(const std::vector<llvm::Value *> &args);
+  llvm::Value *lower_streq(const std::vector<llvm::Value *> &args);
+  llvm::Value *lower_strcmp(const std::vector<llvm::Value *> &args);
+  llvm::Value *call_runtime(const std::string &name, llvm::Type *result_type,
+                            const std::vector<llvm::Value *> &args);
+  llvm::Value *string_length(llvm::Value *s);
+  llvm::Value *first_char(llvm::Value *s);
+  llvm::BasicBlock *new_block(const std::string &name);
+
+  // Frame type and frame of the ancestor levels up from the current
+  // function, taken from the display.
   std::pair<llvm::StructType *, llvm::Value *> frame_up(int levels);
 
+  // Whether a variable is kept in registers rather than in memory.
+  bool in_register(const VarDecl &decl) const;
+  // Record or find the current value of a register variable at the
+  // end of a block.
+  void write_variable(const VarDecl &decl, llvm::BasicBlock *block,
+                      llvm::Value *value);
+  llvm::Value *read_variable(const VarDecl &decl, llvm::BasicBlock *block);
+  llvm::PHINode *new_phi(llvm::Type *type, llvm::BasicBlock *block,
+                         const std::string &name);
+  llvm::Value *add_phi_operands(const VarDecl &decl, llvm::PHINode *phi);
+  // Replace a phi whose operands are all the same value by this
+  // value, and return the value standing for the phi.
+  llvm::Value *remove_trivial_phi(llvm::PHINode *phi);
+  // Declare that all the predecessors of a block are known.
+  void seal_block(llvm::BasicBlock *block);
+
+  // Load and store a variable of the current function, wherever
+  // it lives, at the current insertion point.
+  llvm::Value *load_local(const VarDecl &decl);
+  void store_local(const VarDecl &decl, llvm::Value *value);
+
+  // Give its first value to a variable of the current function,
+  // creating its storage in the frame if it is kept in memory.
+  void declare_local(const VarDecl &decl, llvm::Value *value);
   llvm::Value * generate_vardecl(const VarDecl &decl);
   // Generate the LLVM IR code corresponding to a function
   // declaration. If inner function declarations are encountered,
@@ -71,17 +208,20 @@ class IRGenerator : public ConstASTValueVisitor {
   // Return the LLVM type corresponding to a Tiger type.
   llvm::Type *llvm_type(const ast::Type);
 
-  // Generate a new alloca in the entry block of the function
-  // for a variable of a given type. A name hint can be given,
-  // otherwise automatic naming (%0, %1, etc.) will be used.
-  llvm::Value *alloca_in_entry(llvm::Type *Ty, const std::string &name = "");
+  // Return the address of a variable kept in memory, or its value,
+  // as seen from a function whose variables are at the given depth.
+  llvm::Value *address_of(const VarDecl &decl, int depth);
+  llvm::Value *load_variable(const VarDecl &decl, int depth);
 
-  // Return the address of a given identifier.
-  llvm::Value *address_of(const Identifier &id);
+  // Target machine used to optimize and emit the module, created
+  // lazily for the host triple at the current optimization level.
+  std::unique_ptr<llvm::TargetMachine> Target;
+  unsigned opt_level = 0;
+  llvm::TargetMachine *target_machine();
 
 public:
   // Constructor
-  IRGenerator();
+  explicit IRGenerator(const opt::LambdaLifter *closures = nullptr);
 
   // Given the main function declaration, generate the LLVM IR
   // corresponding to the whole program.
@@ -90,6 +230,42 @@ public:
   // Print the generated IR.
   void print_ir(std::ostream *);
 
+  // Link the runtime bitcode into the module, before optimizing it.
+  // The executable still links the native runtime, which provides
+  // what the bitcode did not.
+  void link_runtime(const std::string &filename);
+
+  // Run the LLVM optimization pipeline (-O0 to -O3) on the
+  // generated module, in-process.
+  void optimize(unsigned level);
+
+  // Number of instructions of the module, for statistics. The module
+  // is gone once emitted in partitions.
+  size_t instruction_count() const;
+
+  // Emit the module as a native object file.
+  void emit_object(const std::string &filename);
+
+  // Number of partitions of the module for the parallel back end, of
+  // at most functions_per_partition defined functions each. It only
+  // depends on the module, so that the objects do not depend on the
+  // number of threads.
+  static const unsigned functions_per_partition = 256;
+  unsigned partition_count() const;
+
+  // Split the module into partitions, then optimize them at the given
+  // level (if it is not negative) and emit them with jobs threads, each
+  // partition in its own context. Returns the object of every
+  // partition. The module cannot be used anymore afterwards.
+  std::vector<std::string> emit_partitions(int level, unsigned jobs);
+
+  // Hand the module over to an ORC JIT, resolve the runtime
+  // primitives from the ones linked into the compiler, and run
+  // main. Returns the program exit status. The module cannot
+  // be used anymore afterwards. The compiled object is given to
+  // cache if there is one.
+  int run(llvm::ObjectCache *cache = nullptr);
+
   // Generate the IR corresponding to those AST nodes.
   // Those methods will return either nullptr when no
   // result is expected (a statement for example),
@@ -110,6 +286,10 @@ public:
   virtual llvm::Value *visit(const Assign &);
 };
 
+// Run the main function of an object compiled by the JIT, as run()
+// does for a module.
+int run_object(std::unique_ptr<llvm::MemoryBuffer> object);
+
 } // namespace irgen
 
 #endif // _IRGEN_HH
@@ -0,0 +1,78 @@
+#ifndef COMPONENTS_HH
+#define COMPONENTS_HH
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace opt {
+
+// Strongly connected components of a graph whose vertices are the
+// integers v below count for which is_vertex(v) holds. The edges of v
+// go to successor(v, 0) up to successor(v, degree(v) - 1). Every
+// component comes after the components it has edges to.
+//
+// Tarjan's algorithm, with an explicit stack as nesting and call
+// chains can be deep.
+template <typename IsVertex, typename Degree, typename Successor>
+std::vector<std::vector<int>>
+strongly_connected_components(size_t count, IsVertex is_vertex,
+                              Degree degree, Successor successor) {
+  struct Visit {
+    int vertex;
+    size_t edge;
+  };
+
+  std::vector<std::vector<int>> result;
+  std::vector<int> order(count, -1);
+  std::vector<int> low(count);
+  std::vector<bool> on_stack(count, false);
+  std::vector<int> stack;
+  std::vector<Visit> path;
+  int next = 0;
+
+  const auto enter = [&](int v) {
+    order[v] = low[v] = next++;
+    stack.push_back(v);
+    on_stack[v] = true;
+    path.push_back({v, 0});
+  };
+
+  for (int root = 0; root < int(count); root++) {
+    if (!is_vertex(root) || order[root] != -1)
+      continue;
+    enter(root);
+    while (!path.empty()) {
+      const int v = path.back().vertex;
+      const size_t edge = path.back().edge++;
+      if (edge < size_t(degree(v))) {
+        const int w = successor(v, edge);
+        if (order[w] == -1)
+          enter(w);
+        else if (on_stack[w])
+          low[v] = std::min(low[v], order[w]);
+        continue;
+      }
+      path.pop_back();
+      if (!path.empty()) {
+        const int parent = path.back().vertex;
+        low[parent] = std::min(low[parent], low[v]);
+      }
+      if (low[v] == order[v]) {
+        result.emplace_back();
+        int member;
+        do {
+          member = stack.back();
+          stack.pop_back();
+          on_stack[member] = false;
+          result.back().push_back(member);
+        } while (member != v);
+      }
+    }
+  }
+  return result;
+}
+
+} // namespace opt
+
+#endif // COMPONENTS_HH
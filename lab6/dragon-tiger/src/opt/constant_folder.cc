@@ -0,0 +1,200 @@
+#include <algorithm>
+
+#include "constant_folder.hh"
+
+namespace opt {
+
+namespace {
+
+// Compute an arithmetic operation on integers. Overflows wrap around as
+// in the generated code. Divisions which fail at run time are not folded.
+bool arithmetic(Operator op, int32_t l, int32_t r, int32_t &result) {
+  switch (op) {
+  case o_plus:
+    result = uint32_t(l) + uint32_t(r);
+    return true;
+  case o_minus:
+    result = uint32_t(l) - uint32_t(r);
+    return true;
+  case o_times:
+    result = uint32_t(l) * uint32_t(r);
+    return true;
+  case o_divide:
+    if (r == 0 || (l == INT32_MIN && r == -1))
+      return false;
+    result = l / r;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Apply a comparison operator given the sign of l - r.
+int32_t comparison(Operator op, int cmp) {
+  switch (op) {
+  case o_eq:
+    return cmp == 0;
+  case o_neq:
+    return cmp != 0;
+  case o_lt:
+    return cmp < 0;
+  case o_le:
+    return cmp <= 0;
+  case o_gt:
+    return cmp > 0;
+  case o_ge:
+    return cmp >= 0;
+  default:
+    assert(false);
+    __builtin_unreachable();
+  }
+}
+
+// Whether an expression can be dropped when its value is not used.
+bool is_pure(const Expr &expr) {
+  if (auto seq = dynamic_cast<const Sequence *>(&expr))
+    return seq->get_exprs().empty();
+  return dynamic_cast<const IntegerLiteral *>(&expr) ||
+         dynamic_cast<const StringLiteral *>(&expr) ||
+         dynamic_cast<const Identifier *>(&expr);
+}
+
+} // namespace
+
+void ConstantFolder::fold(Expr *&slot) {
+  replacement = nullptr;
+  slot->accept(*this);
+  if (replacement) {
+    Expr *const old = slot;
+    slot = replacement;
+    replacement = nullptr;
+    delete old;
+  }
+}
+
+void ConstantFolder::keep(Expr *&child) {
+  replacement = child;
+  // The child must not be freed with its parent.
+  child = nullptr;
+}
+
+Expr *ConstantFolder::integer(const location &loc, int32_t value) {
+  Expr *const literal = new IntegerLiteral(loc, value);
+  literal->set_type(t_int);
+  return literal;
+}
+
+Expr *ConstantFolder::nothing(const location &loc) {
+  Expr *const seq = new Sequence(loc, std::vector<Expr *>());
+  seq->set_type(t_void);
+  return seq;
+}
+
+void ConstantFolder::visit(IntegerLiteral &literal) {}
+
+void ConstantFolder::visit(StringLiteral &literal) {}
+
+void ConstantFolder::visit(BinaryOperator &op) {
+  fold(op.get_left_ptr());
+  fold(op.get_right_ptr());
+
+  const auto l = dynamic_cast<IntegerLiteral *>(&op.get_left());
+  const auto r = dynamic_cast<IntegerLiteral *>(&op.get_right());
+  if (l && r) {
+    int32_t result;
+    if (op.op >= o_eq)
+      replacement = integer(op.loc, comparison(op.op, (l->value > r->value) -
+                                                          (l->value < r->value)));
+    else if (arithmetic(op.op, l->value, r->value, result))
+      replacement = integer(op.loc, result);
+    return;
+  }
+
+  const auto ls = dynamic_cast<StringLiteral *>(&op.get_left());
+  const auto rs = dynamic_cast<StringLiteral *>(&op.get_right());
+  if (ls && rs) {
+    const int cmp = ls->value.get().compare(rs->value.get());
+    replacement = integer(op.loc, comparison(op.op, (cmp > 0) - (cmp < 0)));
+    return;
+  }
+
+  // x + 0, x - 0, x * 1, x / 1, 0 + x and 1 * x are x.
+  if (r && ((r->value == 0 && (op.op == o_plus || op.op == o_minus)) ||
+            (r->value == 1 && (op.op == o_times || op.op == o_divide))))
+    keep(op.get_left_ptr());
+  else if (l && ((l->value == 0 && op.op == o_plus) ||
+                 (l->value == 1 && op.op == o_times)))
+    keep(op.get_right_ptr());
+}
+
+void ConstantFolder::visit(Sequence &seq) {
+  std::vector<Expr *> &exprs = seq.get_exprs();
+  for (auto &expr : exprs)
+    fold(expr);
+
+  // Only the value of the last expression is used.
+  if (exprs.empty())
+    return;
+  auto end = std::remove_if(exprs.begin(), exprs.end() - 1, [](Expr *expr) {
+    if (!is_pure(*expr))
+      return false;
+    delete expr;
+    return true;
+  });
+  exprs.erase(end, exprs.end() - 1);
+}
+
+void ConstantFolder::visit(Let &let) {
+  for (auto decl : let.get_decls())
+    decl->accept(*this);
+  let.get_sequence().accept(*this);
+}
+
+void ConstantFolder::visit(Identifier &id) {}
+
+void ConstantFolder::visit(IfThenElse &ite) {
+  fold(ite.get_condition_ptr());
+  fold(ite.get_then_part_ptr());
+  fold(ite.get_else_part_ptr());
+
+  if (auto cond = dynamic_cast<IntegerLiteral *>(&ite.get_condition()))
+    keep(cond->value ? ite.get_then_part_ptr() : ite.get_else_part_ptr());
+}
+
+void ConstantFolder::visit(VarDecl &decl) {
+  if (decl.get_expr_ptr())
+    fold(decl.get_expr_ptr());
+}
+
+void ConstantFolder::visit(FunDecl &decl) {
+  if (decl.get_expr_ptr())
+    fold(decl.get_expr_ptr());
+}
+
+void ConstantFolder::visit(FunCall &call) {
+  for (auto &arg : call.get_args())
+    fold(arg);
+}
+
+void ConstantFolder::visit(WhileLoop &loop) {
+  fold(loop.get_condition_ptr());
+
+  const auto cond = dynamic_cast<IntegerLiteral *>(&loop.get_condition());
+  if (cond && cond->value == 0) {
+    replacement = nothing(loop.loc);
+    return;
+  }
+  fold(loop.get_body_ptr());
+}
+
+void ConstantFolder::visit(ForLoop &loop) {
+  loop.get_variable().accept(*this);
+  fold(loop.get_high_ptr());
+  fold(loop.get_body_ptr());
+}
+
+void ConstantFolder::visit(Break &brk) {}
+
+void ConstantFolder::visit(Assign &assign) { fold(assign.get_rhs_ptr()); }
+
+} // namespace opt
@@ -0,0 +1,45 @@
+#ifndef CONSTANT_FOLDER_HH
+#define CONSTANT_FOLDER_HH
+
+#include "../ast/nodes.hh"
+
+namespace opt {
+using namespace ast::types;
+
+// Simplify a bound and type-checked program in place. Operators whose
+// operands are literals are computed, neutral operands are dropped, and
+// branches or loops which can never run are removed, so that the code
+// generators get a smaller tree. Discarded nodes are freed: as they may
+// hold escaping declarations, the Escaper must run after this pass.
+class ConstantFolder : public ASTVisitor {
+  // Expression replacing the one being visited, if any.
+  Expr *replacement;
+
+  // Visit the expression held by slot, and substitute its replacement.
+  void fold(Expr *&slot);
+  // Replace the expression being visited by one of its children.
+  void keep(Expr *&child);
+  Expr *integer(const location &loc, int32_t value);
+  Expr *nothing(const location &loc);
+
+public:
+  ConstantFolder() : replacement(nullptr) {}
+  virtual void visit(IntegerLiteral &);
+  virtual void visit(StringLiteral &);
+  virtual void visit(BinaryOperator &);
+  virtual void visit(Sequence &);
+  virtual void visit(Let &);
+  virtual void visit(Identifier &);
+  virtual void visit(IfThenElse &);
+  virtual void visit(VarDecl &);
+  virtual void visit(FunDecl &);
+  virtual void visit(FunCall &);
+  virtual void visit(WhileLoop &);
+  virtual void visit(ForLoop &);
+  virtual void visit(Break &);
+  virtual void visit(Assign &);
+};
+
+} // namespace opt
+
+#endif // CONSTANT_FOLDER_HH
@@ -0,0 +1,512 @@
+#include <algorithm>
+#include <unordered_map>
+
+#include "components.hh"
+#include "inliner.hh"
+
+namespace opt {
+
+namespace {
+
+template <typename T> T &entry(std::vector<T> &table, int id) {
+  assert(id >= 0);
+  if (size_t(id) >= table.size())
+    table.resize(id + 1);
+  return table[id];
+}
+
+// Find the functions with a body, the calls between them and the
+// largest declaration id. Call sites are counted by callee id.
+class Survey : public ConstASTVisitor {
+  std::vector<const FunDecl *> enclosing;
+
+  void declaration(const Decl &decl) {
+    max_id = std::max(max_id, decl.get_id());
+  }
+
+public:
+  std::vector<FunDecl *> functions;
+  std::vector<std::vector<FunDecl *>> calls;
+  std::vector<unsigned> call_sites;
+  std::vector<unsigned> nested_functions;
+  int max_id = -1;
+
+  virtual void visit(const IntegerLiteral &) {}
+  virtual void visit(const StringLiteral &) {}
+  virtual void visit(const BinaryOperator &op) {
+    op.get_left().accept(*this);
+    op.get_right().accept(*this);
+  }
+  virtual void visit(const Sequence &seq) {
+    for (auto expr : seq.get_exprs())
+      expr->accept(*this);
+  }
+  virtual void visit(const Let &let) {
+    for (auto decl : let.get_decls())
+      decl->accept(*this);
+    let.get_sequence().accept(*this);
+  }
+  virtual void visit(const Identifier &) {}
+  virtual void visit(const IfThenElse &ite) {
+    ite.get_condition().accept(*this);
+    ite.get_then_part().accept(*this);
+    ite.get_else_part().accept(*this);
+  }
+  virtual void visit(const VarDecl &decl) {
+    declaration(decl);
+    if (decl.get_expr())
+      decl.get_expr()->accept(*this);
+  }
+  virtual void visit(const FunDecl &decl) {
+    declaration(decl);
+    if (!decl.get_expr())
+      return;
+    if (!enclosing.empty())
+      entry(nested_functions, enclosing.back()->get_id())++;
+    functions.push_back(const_cast<FunDecl *>(&decl));
+    for (auto param : decl.get_params())
+      param->accept(*this);
+    enclosing.push_back(&decl);
+    decl.get_expr()->accept(*this);
+    enclosing.pop_back();
+  }
+  virtual void visit(const FunCall &call) {
+    const FunDecl &callee = call.get_decl().get();
+    declaration(callee);
+    if (callee.get_expr()) {
+      entry(call_sites, callee.get_id())++;
+      entry(calls, enclosing.back()->get_id())
+          .push_back(const_cast<FunDecl *>(&callee));
+    }
+    for (auto arg : call.get_args())
+      arg->accept(*this);
+  }
+  virtual void visit(const WhileLoop &loop) {
+    loop.get_condition().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const ForLoop &loop) {
+    loop.get_variable().accept(*this);
+    loop.get_high().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const Break &) {}
+  virtual void visit(const Assign &assign) { assign.get_rhs().accept(*this); }
+};
+
+// Count the nodes of an expression, nested function bodies excluded.
+class Size : public ConstASTVisitor {
+public:
+  unsigned nodes = 0;
+
+  virtual void visit(const IntegerLiteral &) { nodes++; }
+  virtual void visit(const StringLiteral &) { nodes++; }
+  virtual void visit(const BinaryOperator &op) {
+    nodes++;
+    op.get_left().accept(*this);
+    op.get_right().accept(*this);
+  }
+  virtual void visit(const Sequence &seq) {
+    for (auto expr : seq.get_exprs())
+      expr->accept(*this);
+  }
+  virtual void visit(const Let &let) {
+    for (auto decl : let.get_decls())
+      decl->accept(*this);
+    let.get_sequence().accept(*this);
+  }
+  virtual void visit(const Identifier &) { nodes++; }
+  virtual void visit(const IfThenElse &ite) {
+    nodes++;
+    ite.get_condition().accept(*this);
+    ite.get_then_part().accept(*this);
+    ite.get_else_part().accept(*this);
+  }
+  virtual void visit(const VarDecl &decl) {
+    nodes++;
+    if (decl.get_expr())
+      decl.get_expr()->accept(*this);
+  }
+  virtual void visit(const FunDecl &) { nodes++; }
+  virtual void visit(const FunCall &call) {
+    nodes++;
+    for (auto arg : call.get_args())
+      arg->accept(*this);
+  }
+  virtual void visit(const WhileLoop &loop) {
+    nodes++;
+    loop.get_condition().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const ForLoop &loop) {
+    nodes++;
+    loop.get_variable().accept(*this);
+    loop.get_high().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(const Break &) { nodes++; }
+  virtual void visit(const Assign &assign) {
+    nodes++;
+    assign.get_rhs().accept(*this);
+  }
+};
+
+// Copy the body of a function without nested functions into a caller
+// whose variables are at the given depth. Copied declarations get new
+// ids, and the copied identifiers and breaks refer to the copies.
+class Cloner : public ConstASTVisitor {
+  const int depth;
+  int &next_id;
+  std::unordered_map<const VarDecl *, VarDecl *> vars;
+  std::unordered_map<const Loop *, Loop *> loops;
+  Node *result;
+
+  template <typename N> N *typed(N *node, const Node &original) {
+    if (original.get_type() != t_undef)
+      node->set_type(original.get_type());
+    result = node;
+    return node;
+  }
+
+  VarDecl *declare(const VarDecl &original, Expr *expr) {
+    VarDecl *const decl =
+        new VarDecl(original.loc, original.name, expr, original.type_name,
+                    original.read_only);
+    decl->set_depth(depth);
+    decl->set_id(next_id++);
+    vars[&original] = decl;
+    return typed(decl, original);
+  }
+
+public:
+  Cloner(int _depth, int &_next_id)
+      : depth(_depth), next_id(_next_id), result(nullptr) {}
+
+  // Declare a copy of a parameter, initialized with an argument.
+  VarDecl *bind(const VarDecl &param, Expr *arg) {
+    return declare(param, arg);
+  }
+
+  Expr *copy(const Expr &expr) {
+    expr.accept(*this);
+    return static_cast<Expr *>(result);
+  }
+
+  virtual void visit(const IntegerLiteral &literal) {
+    typed(new IntegerLiteral(literal.loc, literal.value), literal);
+  }
+  virtual void visit(const StringLiteral &literal) {
+    typed(new StringLiteral(literal.loc, literal.value), literal);
+  }
+  virtual void visit(const BinaryOperator &op) {
+    Expr *const left = copy(op.get_left());
+    Expr *const right = copy(op.get_right());
+    typed(new BinaryOperator(op.loc, left, right, op.op), op);
+  }
+  virtual void visit(const Sequence &seq) {
+    std::vector<Expr *> exprs;
+    for (auto expr : seq.get_exprs())
+      exprs.push_back(copy(*expr));
+    typed(new Sequence(seq.loc, exprs), seq);
+  }
+  virtual void visit(const Let &let) {
+    std::vector<Decl *> decls;
+    for (auto decl : let.get_decls()) {
+      decl->accept(*this);
+      decls.push_back(static_cast<Decl *>(result));
+    }
+    Sequence *const seq = static_cast<Sequence *>(copy(let.get_sequence()));
+    typed(new Let(let.loc, decls, seq), let);
+  }
+  virtual void visit(const Identifier &id) {
+    Identifier *const copy = new Identifier(id.loc, id.name);
+    const VarDecl &decl = id.get_decl().get();
+    auto renamed = vars.find(&decl);
+    copy->set_decl(renamed != vars.end() ? renamed->second
+                                         : const_cast<VarDecl *>(&decl));
+    copy->set_depth(depth);
+    typed(copy, id);
+  }
+  virtual void visit(const IfThenElse &ite) {
+    Expr *const condition = copy(ite.get_condition());
+    Expr *const then_part = copy(ite.get_then_part());
+    Expr *const else_part = copy(ite.get_else_part());
+    typed(new IfThenElse(ite.loc, condition, then_part, else_part), ite);
+  }
+  virtual void visit(const VarDecl &decl) {
+    declare(decl, decl.get_expr() ? copy(*decl.get_expr()) : nullptr);
+  }
+  virtual void visit(const FunDecl &) {
+    // Bodies declaring functions are never copied.
+    assert(false);
+  }
+  virtual void visit(const FunCall &call) {
+    std::vector<Expr *> args;
+    for (auto arg : call.get_args())
+      args.push_back(copy(*arg));
+    FunCall *const copy = new FunCall(call.loc, args, call.func_name);
+    copy->set_decl(const_cast<FunDecl *>(&call.get_decl().get()));
+    copy->set_depth(depth);
+    typed(copy, call);
+  }
+  virtual void visit(const WhileLoop &loop) {
+    WhileLoop *const copy =
+        new WhileLoop(loop.loc, this->copy(loop.get_condition()), nullptr);
+    loops[&loop] = copy;
+    copy->get_body_ptr() = this->copy(loop.get_body());
+    typed(copy, loop);
+  }
+  virtual void visit(const ForLoop &loop) {
+    loop.get_variable().accept(*this);
+    VarDecl *const variable = static_cast<VarDecl *>(result);
+    ForLoop *const copy =
+        new ForLoop(loop.loc, variable, this->copy(loop.get_high()), nullptr);
+    loops[&loop] = copy;
+    copy->get_body_ptr() = this->copy(loop.get_body());
+    typed(copy, loop);
+  }
+  virtual void visit(const Break &brk) {
+    Break *const copy = new Break(brk.loc);
+    if (brk.get_loop())
+      copy->set_loop(loops.at(&brk.get_loop().get()));
+    typed(copy, brk);
+  }
+  virtual void visit(const Assign &assign) {
+    Identifier *const lhs = static_cast<Identifier *>(copy(assign.get_lhs()));
+    Expr *const rhs = copy(assign.get_rhs());
+    typed(new Assign(assign.loc, lhs, rhs), assign);
+  }
+};
+
+// Remove the declarations of functions which are never called.
+class Pruner : public ASTVisitor {
+  const std::vector<unsigned> &call_sites;
+
+public:
+  bool removed = false;
+
+  explicit Pruner(const std::vector<unsigned> &_call_sites)
+      : call_sites(_call_sites) {}
+
+  bool dead(const Decl *decl) const {
+    const FunDecl *fun = dynamic_cast<const FunDecl *>(decl);
+    return fun && fun->get_expr() &&
+           (size_t(fun->get_id()) >= call_sites.size() ||
+            call_sites[fun->get_id()] == 0);
+  }
+
+  virtual void visit(IntegerLiteral &) {}
+  virtual void visit(StringLiteral &) {}
+  virtual void visit(BinaryOperator &op) {
+    op.get_left().accept(*this);
+    op.get_right().accept(*this);
+  }
+  virtual void visit(Sequence &seq) {
+    for (auto expr : seq.get_exprs())
+      expr->accept(*this);
+  }
+  virtual void visit(Let &let) {
+    std::vector<Decl *> &decls = let.get_decls();
+    auto end = std::remove_if(decls.begin(), decls.end(), [this](Decl *decl) {
+      if (!dead(decl))
+        return false;
+      delete decl;
+      return true;
+    });
+    removed = removed || end != decls.end();
+    decls.erase(end, decls.end());
+    for (auto decl : decls)
+      decl->accept(*this);
+    let.get_sequence().accept(*this);
+  }
+  virtual void visit(Identifier &) {}
+  virtual void visit(IfThenElse &ite) {
+    ite.get_condition().accept(*this);
+    ite.get_then_part().accept(*this);
+    ite.get_else_part().accept(*this);
+  }
+  virtual void visit(VarDecl &decl) {
+    if (decl.get_expr())
+      decl.get_expr()->accept(*this);
+  }
+  virtual void visit(FunDecl &decl) {
+    if (decl.get_expr())
+      decl.get_expr()->accept(*this);
+  }
+  virtual void visit(FunCall &call) {
+    for (auto arg : call.get_args())
+      arg->accept(*this);
+  }
+  virtual void visit(WhileLoop &loop) {
+    loop.get_condition().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(ForLoop &loop) {
+    loop.get_variable().accept(*this);
+    loop.get_high().accept(*this);
+    loop.get_body().accept(*this);
+  }
+  virtual void visit(Break &) {}
+  virtual void visit(Assign &assign) { assign.get_rhs().accept(*this); }
+};
+
+} // namespace
+
+void Inliner::inline_program(FunDecl &main) {
+  if (threshold == 0)
+    return;
+
+  Survey survey;
+  main.accept(survey);
+  next_id = survey.max_id + 1;
+  functions.resize(next_id);
+  for (FunDecl *decl : survey.functions) {
+    Function &fun = functions[decl->get_id()];
+    fun.decl = decl;
+    if (size_t(decl->get_id()) < survey.calls.size())
+      fun.calls = survey.calls[decl->get_id()];
+    if (size_t(decl->get_id()) < survey.call_sites.size())
+      fun.call_sites = survey.call_sites[decl->get_id()];
+    if (size_t(decl->get_id()) < survey.nested_functions.size())
+      fun.has_nested = survey.nested_functions[decl->get_id()] > 0;
+  }
+
+  // Components of the call graph come after the ones they call, so
+  // that the bodies which are copied have already been expanded. A
+  // function is recursive when it belongs to a cycle.
+  for (const std::vector<int> &members : strongly_connected_components(
+           functions.size(),
+           [this](int v) { return functions[v].decl != nullptr; },
+           [this](int v) { return functions[v].calls.size(); },
+           [this](int v, size_t edge) {
+             return functions[v].calls[edge]->get_id();
+           })) {
+    for (int v : members) {
+      Function &fun = functions[v];
+      fun.recursive =
+          members.size() > 1 ||
+          std::find(fun.calls.begin(), fun.calls.end(), fun.decl) !=
+              fun.calls.end();
+    }
+    for (int v : members)
+      process(functions[v]);
+  }
+
+  while (remove_dead_functions(main))
+    continue;
+}
+
+void Inliner::process(Function &fun) {
+  rewrite(fun.decl->get_expr_ptr());
+
+  Size size;
+  fun.decl->get_expr()->accept(size);
+  fun.inlinable =
+      fun.decl->get_parent() && !fun.recursive && !fun.has_nested &&
+      (size.nodes <= threshold ||
+       (fun.call_sites == 1 && size.nodes <= threshold * single_call_factor));
+}
+
+void Inliner::rewrite(Expr *&slot) {
+  replacement = nullptr;
+  slot->accept(*this);
+  if (replacement) {
+    Expr *const old = slot;
+    slot = replacement;
+    replacement = nullptr;
+    delete old;
+  }
+}
+
+// The call becomes let var p1 := a1 ... var pn := an in body end, with
+// a copy of the body using the copies of the parameters.
+Expr *Inliner::expand(FunCall &call) {
+  const FunDecl &callee = call.get_decl().get();
+  Cloner cloner(call.get_depth(), next_id);
+
+  std::vector<Decl *> decls;
+  std::vector<Expr *> &args = call.get_args();
+  for (size_t i = 0; i < args.size(); i++) {
+    decls.push_back(cloner.bind(*callee.get_params()[i], args[i]));
+    // The argument now belongs to the declaration.
+    args[i] = nullptr;
+  }
+
+  Expr *const body = cloner.copy(*callee.get_expr());
+  Sequence *const seq = new Sequence(call.loc, std::vector<Expr *>({body}));
+  seq->set_type(body->get_type());
+  Let *const let = new Let(call.loc, decls, seq);
+  let->set_type(body->get_type());
+  return let;
+}
+
+bool Inliner::remove_dead_functions(FunDecl &main) {
+  Survey survey;
+  main.accept(survey);
+  Pruner pruner(survey.call_sites);
+  main.accept(pruner);
+  return pruner.removed;
+}
+
+void Inliner::visit(IntegerLiteral &) {}
+
+void Inliner::visit(StringLiteral &) {}
+
+void Inliner::visit(BinaryOperator &op) {
+  rewrite(op.get_left_ptr());
+  rewrite(op.get_right_ptr());
+}
+
+void Inliner::visit(Sequence &seq) {
+  for (auto &expr : seq.get_exprs())
+    rewrite(expr);
+}
+
+void Inliner::visit(Let &let) {
+  for (auto decl : let.get_decls())
+    decl->accept(*this);
+  let.get_sequence().accept(*this);
+}
+
+void Inliner::visit(Identifier &) {}
+
+void Inliner::visit(IfThenElse &ite) {
+  rewrite(ite.get_condition_ptr());
+  rewrite(ite.get_then_part_ptr());
+  rewrite(ite.get_else_part_ptr());
+}
+
+void Inliner::visit(VarDecl &decl) {
+  if (decl.get_expr_ptr())
+    rewrite(decl.get_expr_ptr());
+}
+
+// Nested functions are processed on their own.
+void Inliner::visit(FunDecl &) {}
+
+void Inliner::visit(FunCall &call) {
+  for (auto &arg : call.get_args())
+    rewrite(arg);
+
+  const FunDecl &callee = call.get_decl().get();
+  if (callee.get_expr() && size_t(callee.get_id()) < functions.size() &&
+      functions[callee.get_id()].inlinable)
+    replacement = expand(call);
+}
+
+void Inliner::visit(WhileLoop &loop) {
+  rewrite(loop.get_condition_ptr());
+  rewrite(loop.get_body_ptr());
+}
+
+void Inliner::visit(ForLoop &loop) {
+  loop.get_variable().accept(*this);
+  rewrite(loop.get_high_ptr());
+  rewrite(loop.get_body_ptr());
+}
+
+void Inliner::visit(Break &) {}
+
+void Inliner::visit(Assign &assign) { rewrite(assign.get_rhs_ptr()); }
+
+} // namespace opt
@@ -0,0 +1,77 @@
+#ifndef INLINER_HH
+#define INLINER_HH
+
+#include <vector>
+
+#include "../ast/nodes.hh"
+
+namespace opt {
+using namespace ast::types;
+
+// Substitute the bodies of small functions, and of functions called
+// from a single site, into their calls on a bound and type-checked
+// program. A call becomes a let binding the arguments to copies of the
+// parameters around a copy of the body, whose variables are renamed
+// and moved to the depth of the caller. Functions which are recursive
+// or declare nested functions are never inlined, and functions which
+// are no longer called are removed. As escapes change, the Escaper
+// must run after this pass.
+//
+// A function is small when its body has at most threshold nodes, and
+// a function called once is inlined up to single_call_factor times
+// this size. A zero threshold disables inlining.
+class Inliner : public ASTVisitor {
+public:
+  static const unsigned default_threshold = 16;
+  static const unsigned single_call_factor = 8;
+
+private:
+  struct Function {
+    FunDecl *decl = nullptr;
+    // Functions with a body called by this one.
+    std::vector<FunDecl *> calls;
+    unsigned call_sites = 0;
+    bool has_nested = false;
+    bool recursive = false;
+    bool inlinable = false;
+  };
+  const unsigned threshold;
+  // Indexed by declaration ids.
+  std::vector<Function> functions;
+  // Id given to the next declaration copied.
+  int next_id = 0;
+  // Expression replacing the one being visited, if any.
+  Expr *replacement;
+
+  // Expand the calls of a function whose callees are processed, and
+  // decide whether it is inlinable.
+  void process(Function &fun);
+  // Visit the expression held by slot, and substitute its replacement.
+  void rewrite(Expr *&slot);
+  Expr *expand(FunCall &call);
+  bool remove_dead_functions(FunDecl &main);
+
+public:
+  explicit Inliner(unsigned _threshold = default_threshold)
+      : threshold(_threshold), replacement(nullptr) {}
+  void inline_program(FunDecl &main);
+
+  virtual void visit(IntegerLiteral &);
+  virtual void visit(StringLiteral &);
+  virtual void visit(BinaryOperator &);
+  virtual void visit(Sequence &);
+  virtual void visit(Let &);
+  virtual void visit(Identifier &);
+  virtual void visit(IfThenElse &);
+  virtual void visit(VarDecl &);
+  virtual void visit(FunDecl &);
+  virtual void visit(FunCall &);
+  virtual void visit(WhileLoop &);
+  virtual void visit(ForLoop &);
+  virtual void visit(Break &);
+  virtual void visit(Assign &);
+};
+
+} // namespace opt
+
+#endif // INLINER_HH
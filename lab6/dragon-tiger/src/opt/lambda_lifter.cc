@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <deque>
+
+#include "components.hh"
+#include "lambda_lifter.hh"
+
+namespace opt {
+
+bool LambdaLifter::Variables::add(VarDecl *var) {
+  if (!members.insert(var).second)
+    return false;
+  list.push_back(var);
+  return true;
+}
+
+LambdaLifter::Function &LambdaLifter::function(const FunDecl &decl) {
+  assert(decl.get_id() >= 0);
+  if (size_t(decl.get_id()) >= functions.size())
+    functions.resize(decl.get_id() + 1);
+  return functions[decl.get_id()];
+}
+
+// Variables of a function are one level deeper than the function.
+bool LambdaLifter::is_local(const VarDecl &var, const FunDecl &fun) const {
+  return var.get_depth() == fun.get_depth() + 1;
+}
+
+void LambdaLifter::analyze_program(FunDecl &main) {
+  main.accept(*this);
+
+  for (Function &fun : functions) {
+    if (!fun.decl)
+      continue;
+    // Calls are recorded once per call site.
+    auto by_id = [](const FunDecl *a, const FunDecl *b) {
+      return a->get_id() < b->get_id();
+    };
+    std::sort(fun.calls.begin(), fun.calls.end(), by_id);
+    fun.calls.erase(std::unique(fun.calls.begin(), fun.calls.end()),
+                    fun.calls.end());
+    for (VarDecl *var : fun.uses.list) {
+      if (size_t(var->get_id()) < assigned_outside.size() &&
+          assigned_outside[var->get_id()])
+        fun.reach = std::min(fun.reach, var->get_depth() - 1);
+      else
+        fun.captures.add(var);
+    }
+  }
+
+  // The components a function depends on are complete before it is
+  // processed, so only functions of the same component, which call
+  // each other, need to be processed again. Reaches only decrease and
+  // captures only grow, so this terminates.
+  std::vector<int> component(functions.size(), -1);
+  std::vector<bool> queued(functions.size(), false);
+  std::deque<Function *> worklist;
+  int index = 0;
+  for (const std::vector<Function *> &members : components()) {
+    for (Function *fun : members) {
+      component[fun->decl->get_id()] = index;
+      queued[fun->decl->get_id()] = true;
+      worklist.push_back(fun);
+    }
+    while (!worklist.empty()) {
+      Function &fun = *worklist.front();
+      worklist.pop_front();
+      queued[fun.decl->get_id()] = false;
+      if (!propagate(fun))
+        continue;
+      for (FunDecl *dependent : fun.dependents) {
+        const int id = dependent->get_id();
+        if (component[id] == index && !queued[id]) {
+          queued[id] = true;
+          worklist.push_back(&functions[id]);
+        }
+      }
+    }
+    index++;
+  }
+
+  // Captured variables do not escape anymore. The others were all
+  // assigned from another function.
+  for (Function &fun : functions) {
+    if (!fun.decl)
+      continue;
+    std::vector<VarDecl *> &escaping = fun.decl->get_escaping_decls();
+    for (VarDecl *var : escaping)
+      if (size_t(var->get_id()) >= assigned_outside.size() ||
+          !assigned_outside[var->get_id()])
+        var->get_escapes() = false;
+    escaping.erase(std::remove_if(escaping.begin(), escaping.end(),
+                                  [](VarDecl *var) {
+                                    return !var->get_escapes();
+                                  }),
+                   escaping.end());
+  }
+}
+
+std::vector<std::vector<LambdaLifter::Function *>> LambdaLifter::components() {
+  const auto successor = [this](int v, size_t edge) {
+    const Function &fun = functions[v];
+    return (edge < fun.calls.size() ? fun.calls[edge]
+                                    : fun.nested[edge - fun.calls.size()])
+        ->get_id();
+  };
+
+  std::vector<std::vector<Function *>> result;
+  for (const std::vector<int> &members : strongly_connected_components(
+           functions.size(),
+           [this](int v) { return functions[v].decl != nullptr; },
+           [this](int v) {
+             return functions[v].calls.size() + functions[v].nested.size();
+           },
+           successor)) {
+    result.emplace_back();
+    for (int v : members)
+      result.back().push_back(&functions[v]);
+  }
+  return result;
+}
+
+bool LambdaLifter::propagate(Function &fun) {
+  const FunDecl &decl = *fun.decl;
+  bool changed = false;
+
+  // A callee keeping its static link gets the frame of its parent,
+  // and its captured variables must be available in the caller.
+  for (FunDecl *callee : fun.calls) {
+    const Function &called = functions[callee->get_id()];
+    if (has_static_link(*callee) && callee->get_depth() - 1 < fun.reach) {
+      fun.reach = callee->get_depth() - 1;
+      changed = true;
+    }
+    for (VarDecl *var : called.captures.list)
+      if (!is_local(*var, decl) && fun.captures.add(var))
+        changed = true;
+  }
+
+  // A nested function reaching above this one does it through the
+  // static link of this function.
+  for (FunDecl *child : fun.nested) {
+    const Function &inner = functions[child->get_id()];
+    if (inner.reach < fun.reach) {
+      fun.reach = inner.reach;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool LambdaLifter::has_static_link(const FunDecl &decl) const {
+  if (decl.is_external || !decl.get_parent())
+    return false;
+  return functions.at(decl.get_id()).reach < decl.get_depth();
+}
+
+const std::vector<VarDecl *> &
+LambdaLifter::get_captures(const FunDecl &decl) const {
+  return functions.at(decl.get_id()).captures.list;
+}
+
+void LambdaLifter::visit(IntegerLiteral &) {}
+
+void LambdaLifter::visit(StringLiteral &) {}
+
+void LambdaLifter::visit(BinaryOperator &op) {
+  op.get_left().accept(*this);
+  op.get_right().accept(*this);
+}
+
+void LambdaLifter::visit(Sequence &seq) {
+  for (auto expr : seq.get_exprs())
+    expr->accept(*this);
+}
+
+void LambdaLifter::visit(Let &let) {
+  for (auto decl : let.get_decls())
+    decl->accept(*this);
+  let.get_sequence().accept(*this);
+}
+
+void LambdaLifter::visit(Identifier &id) {
+  // Void variables hold no value.
+  VarDecl &var = id.get_decl().get();
+  if (var.get_type() != t_void && !is_local(var, *enclosing.back()))
+    function(*enclosing.back()).uses.add(&var);
+}
+
+void LambdaLifter::visit(IfThenElse &ite) {
+  ite.get_condition().accept(*this);
+  ite.get_then_part().accept(*this);
+  ite.get_else_part().accept(*this);
+}
+
+void LambdaLifter::visit(VarDecl &decl) {
+  if (decl.get_expr())
+    decl.get_expr()->accept(*this);
+}
+
+void LambdaLifter::visit(FunDecl &decl) {
+  if (!decl.get_expr())
+    return;
+  Function &fun = function(decl);
+  fun.decl = &decl;
+  fun.reach = decl.get_depth();
+  if (!enclosing.empty()) {
+    function(*enclosing.back()).nested.push_back(&decl);
+    function(decl).dependents.push_back(enclosing.back());
+  }
+  enclosing.push_back(&decl);
+  decl.get_expr()->accept(*this);
+  enclosing.pop_back();
+}
+
+void LambdaLifter::visit(FunCall &call) {
+  FunDecl &callee = call.get_decl().get();
+  if (callee.get_expr()) {
+    function(*enclosing.back()).calls.push_back(&callee);
+    function(callee).dependents.push_back(enclosing.back());
+  }
+  for (auto arg : call.get_args())
+    arg->accept(*this);
+}
+
+void LambdaLifter::visit(WhileLoop &loop) {
+  loop.get_condition().accept(*this);
+  loop.get_body().accept(*this);
+}
+
+void LambdaLifter::visit(ForLoop &loop) {
+  loop.get_variable().accept(*this);
+  loop.get_high().accept(*this);
+  loop.get_body().accept(*this);
+}
+
+void LambdaLifter::visit(Break &) {}
+
+void LambdaLifter::visit(Assign &assign) {
+  VarDecl &var = assign.get_lhs().get_decl().get();
+  if (!is_local(var, *enclosing.back())) {
+    if (size_t(var.get_id()) >= assigned_outside.size())
+      assigned_outside.resize(var.get_id() + 1);
+    assigned_outside[var.get_id()] = true;
+  }
+  assign.get_lhs().accept(*this);
+  assign.get_rhs().accept(*this);
+}
+
+} // namespace opt
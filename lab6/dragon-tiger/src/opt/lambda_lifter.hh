@@ -0,0 +1,90 @@
+#ifndef LAMBDA_LIFTER_HH
+#define LAMBDA_LIFTER_HH
+
+#include <unordered_set>
+#include <vector>
+
+#include "../ast/nodes.hh"
+
+namespace opt {
+using namespace ast::types;
+
+// Decide how nested functions reach the variables of their ancestors,
+// on a bound and escaped program. Variables which are only assigned in
+// their own function cannot change while a nested function runs: they
+// are captured, that is passed by value as extra arguments. Only the
+// variables assigned from nested functions are still accessed through
+// the static links, and only those escape into the frames. A function
+// which needs no ancestor frame, directly or through its callees and
+// nested functions, loses its static link.
+//
+// Results are indexed by the ids of the function declarations.
+class LambdaLifter : public ASTVisitor {
+  // Variables in the order in which they were added, without
+  // duplicates.
+  struct Variables {
+    std::vector<VarDecl *> list;
+    std::unordered_set<const VarDecl *> members;
+    // Returns whether the variable was not there yet.
+    bool add(VarDecl *var);
+  };
+  struct Function {
+    FunDecl *decl = nullptr;
+    // Variables of ancestors read or written by the function itself.
+    Variables uses;
+    // Functions with a body called by the function.
+    std::vector<FunDecl *> calls;
+    // Functions declared directly in the function.
+    std::vector<FunDecl *> nested;
+    // Functions whose needs depend on this one: its callers and its
+    // parent.
+    std::vector<FunDecl *> dependents;
+    // Depth of the outermost frame needed by the function, its own
+    // frame being at its depth.
+    int reach = 0;
+    Variables captures;
+  };
+  std::vector<Function> functions;
+  // Functions being visited, innermost last.
+  std::vector<FunDecl *> enclosing;
+  // Variables assigned outside of their function, by declaration id.
+  std::vector<bool> assigned_outside;
+
+  Function &function(const FunDecl &decl);
+  bool is_local(const VarDecl &var, const FunDecl &fun) const;
+  // Strongly connected components of the graph whose edges go from
+  // the functions to their callees and nested functions, each one
+  // after the components it depends on.
+  std::vector<std::vector<Function *>> components();
+  // Take the needs of the callees and nested functions. Returns
+  // whether anything changed.
+  bool propagate(Function &fun);
+
+public:
+  void analyze_program(FunDecl &main);
+
+  // Whether a function with a body keeps its static link.
+  bool has_static_link(const FunDecl &decl) const;
+  // Variables passed by value to a function with a body, after its
+  // parameters.
+  const std::vector<VarDecl *> &get_captures(const FunDecl &decl) const;
+
+  virtual void visit(IntegerLiteral &);
+  virtual void visit(StringLiteral &);
+  virtual void visit(BinaryOperator &);
+  virtual void visit(Sequence &);
+  virtual void visit(Let &);
+  virtual void visit(Identifier &);
+  virtual void visit(IfThenElse &);
+  virtual void visit(VarDecl &);
+  virtual void visit(FunDecl &);
+  virtual void visit(FunCall &);
+  virtual void visit(WhileLoop &);
+  virtual void visit(ForLoop &);
+  virtual void visit(Break &);
+  virtual void visit(Assign &);
+};
+
+} // namespace opt
+
+#endif // LAMBDA_LIFTER_HH
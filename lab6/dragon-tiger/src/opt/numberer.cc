@@ -0,0 +1,83 @@
+#include "numberer.hh"
+
+namespace opt {
+
+int Numberer::number_program(FunDecl &main) {
+  next_id = 0;
+  externals.clear();
+  main.accept(*this);
+  return next_id;
+}
+
+void Numberer::visit(IntegerLiteral &) {}
+
+void Numberer::visit(StringLiteral &) {}
+
+void Numberer::visit(BinaryOperator &op) {
+  op.get_left().accept(*this);
+  op.get_right().accept(*this);
+}
+
+void Numberer::visit(Sequence &seq) {
+  for (auto expr : seq.get_exprs())
+    expr->accept(*this);
+}
+
+void Numberer::visit(Let &let) {
+  for (auto decl : let.get_decls())
+    decl->accept(*this);
+  let.get_sequence().accept(*this);
+}
+
+void Numberer::visit(Identifier &) {}
+
+void Numberer::visit(IfThenElse &ite) {
+  ite.get_condition().accept(*this);
+  ite.get_then_part().accept(*this);
+  ite.get_else_part().accept(*this);
+}
+
+void Numberer::visit(VarDecl &decl) {
+  number(decl);
+  if (decl.get_expr())
+    decl.get_expr()->accept(*this);
+}
+
+void Numberer::visit(FunDecl &decl) {
+  if (!decl.get_expr()) {
+    if (externals.insert(&decl).second)
+      number(decl);
+    return;
+  }
+  number(decl);
+  for (auto param : decl.get_params())
+    param->accept(*this);
+  decl.get_expr()->accept(*this);
+}
+
+// Functions with a body are numbered where they are declared, which
+// is always in the program.
+void Numberer::visit(FunCall &call) {
+  FunDecl &callee = call.get_decl().get();
+  if (!callee.get_expr())
+    callee.accept(*this);
+  for (auto arg : call.get_args())
+    arg->accept(*this);
+}
+
+void Numberer::visit(WhileLoop &loop) {
+  loop.get_condition().accept(*this);
+  loop.get_body().accept(*this);
+}
+
+void Numberer::visit(ForLoop &loop) {
+  loop.get_variable().accept(*this);
+  loop.get_high().accept(*this);
+  loop.get_body().accept(*this);
+}
+
+void Numberer::visit(Break &) {}
+
+void Numberer::visit(Assign &assign) { assign.get_rhs().accept(*this); }
+
+} // namespace opt
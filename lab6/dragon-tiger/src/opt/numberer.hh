@@ -0,0 +1,52 @@
+#ifndef NUMBERER_HH
+#define NUMBERER_HH
+
+#include <unordered_set>
+
+#include "../ast/nodes.hh"
+
+namespace opt {
+using namespace ast::types;
+
+// Give dense ids, from 0, to the declarations of a bound program: main,
+// the variables, the parameters, the functions, and the primitives it
+// calls. The passes which follow keep their per-declaration data in
+// tables indexed by these ids.
+//
+// The binder of the front-end library does not set ids, and the nodes
+// it builds may hold anything there, so every id is overwritten. This
+// runs after binding, and again after passes which remove or copy
+// declarations, to keep the ids dense.
+class Numberer : public ASTVisitor {
+  int next_id;
+  // Declarations without a body, which are numbered at their first
+  // call.
+  std::unordered_set<const FunDecl *> externals;
+
+  void number(Decl &decl) { decl.set_id(next_id++); }
+
+public:
+  Numberer() : next_id(0) {}
+  // Number the declarations of a program, and return how many there
+  // are.
+  int number_program(FunDecl &main);
+
+  virtual void visit(IntegerLiteral &);
+  virtual void visit(StringLiteral &);
+  virtual void visit(BinaryOperator &);
+  virtual void visit(Sequence &);
+  virtual void visit(Let &);
+  virtual void visit(Identifier &);
+  virtual void visit(IfThenElse &);
+  virtual void visit(VarDecl &);
+  virtual void visit(FunDecl &);
+  virtual void visit(FunCall &);
+  virtual void visit(WhileLoop &);
+  virtual void visit(ForLoop &);
+  virtual void visit(Break &);
+  virtual void visit(Assign &);
+};
+
+} // namespace opt
+
+#endif // NUMBERER_HH
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gc.h"
+
+// Values of the gc field of collected strings.
+#define GC_MANAGED 1
+#define GC_MARKED 2
+
+// A collection is triggered once the heap has grown by its live size
+// since the previous collection, but not before GC_MIN_HEAP bytes
+// have been allocated.
+#ifndef GC_MIN_HEAP
+#define GC_MIN_HEAP (1 << 20)
+#endif
+
+// Every collected string is preceded by a header linking it with
+// the others, so that the sweep phase can find unmarked strings.
+struct gc_header {
+  struct gc_header *next;
+  size_t size;
+};
+
+#define STRING(header) ((struct tiger_string *) ((header) + 1))
+
+struct gc_frame *__gc_top = NULL;
+
+static struct gc_header *objects = NULL;
+static size_t allocated = 0;
+static size_t threshold = GC_MIN_HEAP;
+
+static gc_scanner scanner = NULL;
+static void *scanner_data = NULL;
+
+void __gc_set_scanner(gc_scanner s, void *data) {
+  scanner = s;
+  scanner_data = data;
+}
+
+void __gc_mark(const struct tiger_string *s) {
+  // Strings are flat, so marking does not need to recurse. Static
+  // strings may be in read-only memory and are left untouched.
+  if (s != NULL && s->gc != 0) {
+    ((struct tiger_string *) s)->gc |= GC_MARKED;
+  }
+}
+
+static void collect(void) {
+  for (const struct gc_frame *frame = __gc_top; frame != NULL;
+       frame = frame->next) {
+    for (int64_t i = 0; i < frame->map->count; i++) {
+      __gc_mark(*(const struct tiger_string *const *) ((const char *) frame +
+                                                       frame->map->offsets[i]));
+    }
+  }
+  if (scanner != NULL) {
+    scanner(scanner_data);
+  }
+
+  size_t live = 0;
+  struct gc_header **link = &objects;
+  while (*link != NULL) {
+    struct gc_header *header = *link;
+    struct tiger_string *s = STRING(header);
+    if (s->gc & GC_MARKED) {
+      s->gc = GC_MANAGED;
+      live += header->size;
+      link = &header->next;
+    } else {
+      *link = header->next;
+      free(header);
+    }
+  }
+
+  allocated = live;
+  threshold = live + (live > GC_MIN_HEAP ? live : GC_MIN_HEAP);
+}
+
+struct tiger_string *gc_alloc_string(int32_t length,
+                                     const struct tiger_string *keep1,
+                                     const struct tiger_string *keep2) {
+  const size_t size = sizeof(struct gc_header) + sizeof(struct tiger_string) +
+                      (size_t) length + 1;
+  if (allocated + size > threshold) {
+    __gc_mark(keep1);
+    __gc_mark(keep2);
+    collect();
+  }
+
+  struct gc_header *header = (struct gc_header *) malloc(size);
+  if (header == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(EXIT_FAILURE);
+  }
+  header->next = objects;
+  header->size = size;
+  objects = header;
+  allocated += size;
+
+  struct tiger_string *s = STRING(header);
+  s->length = length;
+  s->gc = GC_MANAGED;
+  s->data[length] = '\0';
+  return s;
+}
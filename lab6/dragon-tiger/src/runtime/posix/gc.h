@@ -0,0 +1,14 @@
+#ifndef GC_H
+#define GC_H
+
+#include "runtime.h"
+
+// Allocate a string able to hold length chars, and its final NUL, in
+// the collected heap. This may trigger a collection: keep1 and keep2
+// (which may be NULL) are strings still needed by the caller, such as
+// its arguments, which are not known to be rooted elsewhere.
+struct tiger_string *gc_alloc_string(int32_t length,
+                                     const struct tiger_string *keep1,
+                                     const struct tiger_string *keep2);
+
+#endif // GC_H
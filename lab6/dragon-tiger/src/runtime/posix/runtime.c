@@ -2,20 +2,37 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "gc.h"
 #include "runtime.h"
 
+struct tiger_char __chars[256];
+
 __attribute__((noreturn))
 static void error(const char *msg) {
   fprintf(stderr, "%s\n", msg);
   exit(EXIT_FAILURE);
 }
 
-void __print_err(const char *s) {
-  fprintf(stderr, "%s", s);
+// Literals live as long as the program, outside of the collected heap.
+const struct tiger_string *__make_string(const char *s, int32_t length) {
+  struct tiger_string *str =
+      (struct tiger_string *) malloc(sizeof(struct tiger_string) + length + 1);
+  if (str == NULL) {
+    error("out of memory");
+  }
+  str->length = length;
+  str->gc = 0;
+  memcpy(str->data, s, length);
+  str->data[length] = '\0';
+  return str;
+}
+
+void __print_err(const struct tiger_string *s) {
+  fwrite(s->data, 1, s->length, stderr);
 }
 
-void __print(const char *s) {
-  fprintf(stdout, "%s", s);
+void __print(const struct tiger_string *s) {
+  fwrite(s->data, 1, s->length, stdout);
 }
 
 void __print_int(const int32_t i) {
@@ -26,85 +43,81 @@ void __flush(void) {
   fflush(stdout);
 }
 
-const char *__getchar(void) {
-  char * s = (char *) malloc(sizeof(char));
-  *s = getchar();
-  if(*s == EOF){
-    return "";
+const struct tiger_string *__getchar(void) {
+  int c = getchar();
+  if (c == EOF) {
+    return __chr(0);
   }
-  return s;  
+  return __chr(c);
 }
 
-int32_t __ord(const char *s){
-  unsigned char c = *s;
-  if(c == '\0'){
+int32_t __ord(const struct tiger_string *s) {
+  if (s->length == 0) {
     return -1;
   }
-  return (int32_t) c;
+  return (int32_t) (unsigned char) s->data[0];
 }
 
-const char *__chr(int32_t i) {
-  char * s = (char *) malloc(sizeof(char));
-  if (i == 0) {
-    return "";
-  }
-  if (i<0 || i>255){
+const struct tiger_string *__chr(int32_t i) {
+  if (i < 0 || i > 255) {
     error("char out of range [0;255]");
   }
-  *s = (char) i%128;
-  return s;
-}
-
-int32_t __size(const char *s) {
-  int32_t i = 0;
-  while (s[i] != '\0') {
-    i++;
-    if (i == 0) {
-      error("Maximal size reached.");
-    }
+  if (i != 0 && __chars[i].length == 0) {
+    __chars[i].length = 1;
+    __chars[i].data[0] = (char) i;
   }
-  return i;
+  return (const struct tiger_string *) &__chars[i];
 }
 
-const char *__substring(const char *s, int32_t first, int32_t length) {
-  char * substr = (char *) malloc(sizeof(char) * (length + 1));
-  int32_t size = __size(s); // get length the string containing substring
-  uint32_t idx = 0;
+int32_t __size(const struct tiger_string *s) {
+  return s->length;
+}
 
-  if (first < 0 || length < 0 || (first + length) > size){
+const struct tiger_string *__substring(const struct tiger_string *s,
+                                       int32_t first, int32_t length) {
+  if (first < 0 || length < 0 || first > s->length - length) {
     error("arguments incorrect or out of bounds.");
   }
 
-  while (idx < length) {
-    substr[idx] = s[first + idx];
-    idx++;
+  // Strings are immutable, so they can be shared.
+  if (length == s->length) {
+    return s;
+  }
+  if (length == 1) {
+    return __chr((unsigned char) s->data[first]);
   }
 
+  struct tiger_string *substr = gc_alloc_string(length, s, NULL);
+  memcpy(substr->data, s->data + first, length);
   return substr;
 }
 
-const char *__concat(const char *s1, const char *s2) {
-  int32_t size_1 = __size(s1);
-  int32_t size_2 = __size(s2);
-  int32_t size_total = size_1 + size_2;
-  int32_t idx = 0;
-  char * s3 = (char *) malloc(sizeof(char)*(size_total + 1));
-
-  while (idx < size_1) {
-    s3[idx] = s1[idx];
-    idx++;
+const struct tiger_string *__concat(const struct tiger_string *s1,
+                                    const struct tiger_string *s2) {
+  if (s1->length == 0) {
+    return s2;
   }
-
-  while (idx < size_total) {
-    s3[idx] = s2[idx - size_1];
-    idx++;
+  if (s2->length == 0) {
+    return s1;
+  }
+  if (s1->length > INT32_MAX - s2->length) {
+    error("Maximal size reached.");
   }
 
+  struct tiger_string *s3 = gc_alloc_string(s1->length + s2->length, s1, s2);
+  memcpy(s3->data, s1->data, s1->length);
+  memcpy(s3->data + s1->length, s2->data, s2->length);
   return s3;
 }
 
-int32_t __strcmp(const char *s1, const char *s2) {
-  int cmp = strcmp(s1, s2);
+int32_t __strcmp(const struct tiger_string *s1,
+                 const struct tiger_string *s2) {
+  int32_t length = s1->length < s2->length ? s1->length : s2->length;
+  int cmp = memcmp(s1->data, s2->data, length);
+
+  if (cmp == 0) {
+    cmp = s1->length - s2->length;
+  }
 
   if (cmp < 0) {
     return -1;
@@ -115,9 +128,12 @@ int32_t __strcmp(const char *s1, const char *s2) {
   }
 }
 
-int32_t __streq(const char *s1, const char *s2) {
-  int32_t res = strcmp(s1, s2);
-  return (res == 0);
+int32_t __streq(const struct tiger_string *s1,
+                const struct tiger_string *s2) {
+  if (s1->length != s2->length) {
+    return 0;
+  }
+  return s1 == s2 || memcmp(s1->data, s2->data, s1->length) == 0;
 }
 
 int32_t __not(int32_t i) {
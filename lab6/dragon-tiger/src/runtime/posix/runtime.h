@@ -3,11 +3,77 @@
 
 #include <stdint.h>
 
-// Print a null-terminated string on standard error.
-void __print_err(const char *s);
-
-// Print a null-terminated string on standard output.
-void __print(const char *s);
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Tiger strings are immutable and carry their length, so that the
+// size of a string is known without scanning it. The characters are
+// always followed by a NUL byte so that they can be handed to C
+// functions. The layout is only visible from C, other users (such as
+// the compiler) go through pointers.
+//
+// Strings built at run time live in a garbage-collected heap, others
+// (literals, single chars) are never freed and have a zero gc field.
+#ifdef __cplusplus
+struct tiger_string;
+#else
+struct tiger_string {
+  int32_t length;
+  uint32_t gc;
+  char data[];
+};
+#endif
+
+// The generated code keeps its string roots in its frames, and links
+// the frames holding any root in a shadow stack whose top is
+// __gc_top. A frame map gives the number of roots and their offsets
+// from the start of the frame, which must begin with a gc_frame.
+#ifdef __cplusplus
+struct gc_frame;
+#else
+struct gc_map {
+  int64_t count;
+  int64_t offsets[];
+};
+
+struct gc_frame {
+  struct gc_frame *next;
+  const struct gc_map *map;
+};
+#endif
+
+extern struct gc_frame *__gc_top;
+
+// Single-character strings, indexed by their character, with the
+// layout of a string. __chr fills an entry on its first use, after
+// which the generated code reads it directly. The string for
+// character 0 is the empty string.
+struct tiger_char {
+  int32_t length;
+  uint32_t gc;
+  char data[2];
+};
+
+extern struct tiger_char __chars[256];
+
+// Execution engines which do not use the shadow stack register a
+// scanner, called on every collection with its data. The scanner
+// reports every string it holds through __gc_mark. Registering a
+// null scanner removes the current one.
+typedef void (*gc_scanner)(void *data);
+void __gc_set_scanner(gc_scanner scanner, void *data);
+void __gc_mark(const struct tiger_string *s);
+
+// Build a string from length chars. This is not a Tiger primitive,
+// it is used by execution engines to create string literals.
+const struct tiger_string *__make_string(const char *s, int32_t length);
+
+// Print a string on standard error.
+void __print_err(const struct tiger_string *s);
+
+// Print a string on standard output.
+void __print(const struct tiger_string *s);
 
 // Print a 32 bit signed integer on standard output.
 void __print_int(int32_t i);
@@ -18,20 +84,20 @@ void __flush(void);
 // Read a char from standard input and return a string
 // containing it. If no char is available (end-of-file),
 // return the empty string.
-const char *__getchar(void);
+const struct tiger_string *__getchar(void);
 
 // Return the ASCII code of the char in first position
 // in the string, or -1 if the string is empty.
-int32_t __ord(const char *s);
+int32_t __ord(const struct tiger_string *s);
 
 // Return a string containing the character whose ASCII
 // code is given as argument. 0 will return the empty
 // string, negative values or values above 255 will
 // bail out with a fatal runtime error.
-const char *__chr(int32_t i);
+const struct tiger_string *__chr(int32_t i);
 
 // Return the length of a string.
-int32_t __size(const char *);
+int32_t __size(const struct tiger_string *s);
 
 // Return a substring of s starting at character first
 // with length length. Bail out with a fatal runtime error
@@ -41,16 +107,18 @@ int32_t __size(const char *);
 // Getting an empty substring is possible (length = 0)
 // as long as first + length is not greater than the
 // string length, so __substring("", 0, 0) is acceptable.
-const char *__substring(const char *s, int32_t first, int32_t length);
+const struct tiger_string *__substring(const struct tiger_string *s,
+                                       int32_t first, int32_t length);
 
 // Concatenate two strings.
-const char *__concat(const char *s1, const char *s2);
+const struct tiger_string *__concat(const struct tiger_string *s1,
+                                    const struct tiger_string *s2);
 
 // Compare two strings and return -1, 0, or 1.
-int32_t __strcmp(const char *s1, const char *s2);
+int32_t __strcmp(const struct tiger_string *s1, const struct tiger_string *s2);
 
 // Check if two strings are equal and return 0 or 1.
-int32_t __streq(const char *s1, const char *s2);
+int32_t __streq(const struct tiger_string *s1, const struct tiger_string *s2);
 
 // Logical not, return 0 or 1.
 int32_t __not(int32_t i);
@@ -58,4 +126,8 @@ int32_t __not(int32_t i);
 // Exit to the operating system with the given exit status.
 void __exit(int32_t c);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // RUNTIME_H
@@ -32,4 +32,6 @@ Symbol::Symbol(std::string const &s) {
     str = *f;
 }
 
+size_t Symbol::count() { return symbols ? symbols->size() : 0; }
+
 } // namespace utils
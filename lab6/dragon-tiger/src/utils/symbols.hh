@@ -21,6 +21,8 @@ public:
   Symbol() : str(nullptr) {}
   Symbol(std::string const &);
   Symbol(Symbol const &s) : str(s.str) {}
+  // Number of distinct symbols, for statistics.
+  static size_t count();
   size_t hash() const noexcept { return std::hash<std::string>()(*str); }
   std::string const &get() const { return *str; }
   operator std::string() const { return *str; }